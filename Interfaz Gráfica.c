@@ -1,18 +1,164 @@
+import time
+_T_START = time.perf_counter()      # referencia para medir el arranque (ver _report_startup)
 import sys
+import os
+import importlib
 import numpy as np
-import pyqtgraph as pg
-pg.setConfigOptions(antialias=True)
-from pyqtgraph.Qt import QtCore, QtWidgets, QtGui
+# Qt directo: pyqtgraph (lo más pesado del arranque) se carga con la primera gráfica
+from PyQt6 import QtCore, QtWidgets, QtGui
 import serial
 import serial.tools.list_ports
 from collections import deque
 import traceback
-import numpy.fft as fft 
+import struct
+import queue
+from concurrent.futures import ThreadPoolExecutor
+
+# Adquisición y formatos de registro viven en módulos sin Qt (ver motor_emg.py)
+from motor_emg import (AcquisitionEngine, PortMonitor, TriggeredCapture, ChannelCalibration, ACQ_PROFILES, DEFAULT_ACQ_PROFILE, BAUD_RATES,
+                       SIGNAL_TYPES, GAINS, LOWPASS_VALUES, HIGHPASS_VALUES,
+                       format_channel_command, describe_channel_config, max_rate_per_channel, process_rss_mb,
+                       wire_format_name)
+from registro_emg import (EMGRecorder, EMGZWriter, EMGZReader, EMGOverview,
+                          EXPORT_FORMATS, WIRE_COLUMN_OF_CHANNEL, convert_recording)
+from analisis_emg import WelchPSD, CrossSpectrum
+_T_IMPORTS = time.perf_counter()
+# -v/--verbose: mensajes de diagnóstico (tiempos de arranque y de carga diferida)
+VERBOSE = any(a in ('-v', '--verbose') for a in sys.argv[1:])
+
+
+class _LazyModule:
+    """Módulo que se importa al primer acceso a un atributo; 'load_s' dice cuánto tardó."""
+    def __init__(self, name: str, on_load=None):
+        self._name = name
+        self._on_load = on_load
+        self._mod = None
+        self.load_s = None
+
+    def __getattr__(self, attr):
+        if self._mod is None:
+            t0 = time.perf_counter()
+            self._mod = importlib.import_module(self._name)
+            if self._on_load is not None:
+                self._on_load(self._mod)
+            self.load_s = time.perf_counter() - t0
+            if VERBOSE:
+                print(f"[INFO] {self._name} cargado bajo demanda en {self.load_s * 1000:.0f} ms")
+        return getattr(self._mod, attr)
+
+
+pg = _LazyModule('pyqtgraph', lambda m: m.setConfigOptions(antialias=True))
+
+
+def _report_startup(t_window: float):
+    """Imprime el tiempo hasta la ventana y la memoria tras el primer ciclo de eventos."""
+    if not VERBOSE:
+        return
+    now = time.perf_counter()
+    print(f"[INFO] Arranque: importaciones {(_T_IMPORTS - _T_START) * 1000:.0f} ms, "
+          f"ventana construida {(t_window - _T_START) * 1000:.0f} ms, "
+          f"primer ciclo de eventos {(now - _T_START) * 1000:.0f} ms; RSS {process_rss_mb():.1f} MB; "
+          f"pyqtgraph {'cargado' if pg.load_s is not None else 'aún sin cargar'}")
+
+
+def _fft_mag_batch(Y: np.ndarray, plan: dict) -> np.ndarray:
+    """FFT bilateral por filas de Y (k, N) con el plan dado; magnitud normalizada (k, nfft)."""
+    Yw = Y.astype(np.float64) * plan['win']
+    F = np.fft.fftshift(np.fft.fft(Yw, n=plan['nfft'], axis=1), axes=1)
+    return np.abs(F) / plan['norm']
+
+
+def _fft_db_job(seq: int, chans: list, Y: np.ndarray, plan: dict):
+    """Trabajo del pool: quita la media, FFT en lote y pasa a dB. No toca widgets."""
+    Y = Y - Y.mean(axis=1, keepdims=True)
+    mag_db = 20*np.log10(np.maximum(_fft_mag_batch(Y, plan), 1e-12))
+    return seq, chans, plan['f'], mag_db
+
+
+class _YRangeTracker:
+    """Rango Y de un canal sin recorrer la ventana en cada repintado.
+
+    Mín./máx. de las últimas 'window' muestras con deques monótonos: de cada bloque
+    solo entran los máximos/mínimos de sufijo (una muestra con otra posterior mayor
+    nunca será el máximo). El rango del eje se mueve con histéresis: solo cuando la
+    señal sale de la banda o pasa a ocupar menos de SHRINK de ella.
+    """
+    MARGIN = 0.1        # holgura a cada lado, en fracción de la amplitud
+    SHRINK = 0.5
+    MIN_SPAN = 1e-6     # V (en el electrodo); evita un rango nulo con señal plana
+
+    def __init__(self, window: int):
+        self.window = int(window)
+        self.clear()
+
+    def clear(self):
+        self.n = 0
+        self._max = deque()     # (índice, valor), valores decrecientes
+        self._min = deque()     # (índice, valor), valores crecientes
+        self.range = None
+
+    def set_window(self, window: int):
+        self.window = int(window)
+        self._expire()
+
+    def extend(self, y: np.ndarray):
+        m = len(y)
+        if m == 0:
+            return
+        rev = y[::-1]
+        suf_max = np.maximum.accumulate(rev)[::-1]
+        suf_min = np.minimum.accumulate(rev)[::-1]
+        cand_max = np.flatnonzero(np.append(y[:-1] > suf_max[1:], True))
+        cand_min = np.flatnonzero(np.append(y[:-1] < suf_min[1:], True))
+        # Los candidatos ya son monótonos: basta con podar la cola contra el primero
+        v = y[cand_max[0]]
+        while self._max and self._max[-1][1] <= v:
+            self._max.pop()
+        self._max.extend(zip((self.n + cand_max).tolist(), y[cand_max].tolist()))
+        v = y[cand_min[0]]
+        while self._min and self._min[-1][1] >= v:
+            self._min.pop()
+        self._min.extend(zip((self.n + cand_min).tolist(), y[cand_min].tolist()))
+        self.n += m
+        self._expire()
+
+    def _expire(self):
+        first = self.n - self.window
+        while self._max and self._max[0][0] < first:
+            self._max.popleft()
+        while self._min and self._min[0][0] < first:
+            self._min.popleft()
+
+    def extrema(self):
+        if not self._max:
+            return None
+        return self._min[0][1], self._max[0][1]
+
+    def update_range(self):
+        """Nuevo (lo, hi) si hay que mover el eje; None si la señal sigue dentro de la banda."""
+        ext = self.extrema()
+        if ext is None:
+            return None
+        mn, mx = ext
+        if self.range is not None:
+            lo, hi = self.range
+            if lo <= mn and mx <= hi and (mx - mn) >= self.SHRINK * (hi - lo) - self.MIN_SPAN:
+                return None
+        span = max(mx - mn, self.MIN_SPAN)
+        self.range = (mn - self.MARGIN * span, mx + self.MARGIN * span)
+        return self.range
+
+
+class _FFTResultBridge(QtCore.QObject):
+    """Lleva los resultados del pool al hilo de la GUI (conexión en cola)."""
+    ready = QtCore.pyqtSignal(object)
+
 
 class SerialConfigDialog(QtWidgets.QDialog):
-    def __init__(self, current_params, parent=None):
+    def __init__(self, current_params, parent=None, port_monitor=None):
         super().__init__(parent)
         self.setWindowTitle("Configuración de Puerto Serial")
+        self.port_monitor = port_monitor
         self.setMinimumWidth(350)
 
         self.stopbits_mapping = {
@@ -41,10 +187,16 @@ class SerialConfigDialog(QtWidgets.QDialog):
         self.port_combo = QtWidgets.QComboBox()
         self.refresh_ports(current_params.get('port'))
         self.btn_refresh = QtWidgets.QPushButton("Actualizar")
-        self.btn_refresh.clicked.connect(lambda: self.refresh_ports(self.port_combo.currentData()))
+        self.btn_refresh.clicked.connect(self._on_refresh_clicked)
+        if self.port_monitor is not None:
+            # La lista se actualiza sola al conectar/desconectar dispositivos
+            self._ports_version = self.port_monitor.version
+            self._ports_timer = QtCore.QTimer(self)
+            self._ports_timer.timeout.connect(self._check_ports_changed)
+            self._ports_timer.start(300)
 
         self.baud_combo = QtWidgets.QComboBox()
-        baud_rates = ['4800', '9600', '19200', '38400', '57600', '115200']
+        baud_rates = [str(b) for b in BAUD_RATES]
         self.baud_combo.addItems(baud_rates)
         current_baud_val = current_params.get('baudrate', 115200)
         current_baud_text = str(current_baud_val)
@@ -78,6 +230,14 @@ class SerialConfigDialog(QtWidgets.QDialog):
         self.timeout = QtWidgets.QLineEdit(str(timeout_ms))
         self.timeout.setValidator(QtGui.QIntValidator(0, 60000, self))
 
+        # Formato de datos: 12 bits empaquetados ahorra un 25% del enlace
+        self.packed12 = QtWidgets.QCheckBox("Datos empaquetados de 12 bits")
+        self.packed12.setChecked(bool(current_params.get('packed12', False)))
+        self.capacity_label = QtWidgets.QLabel()
+        self.baud_combo.currentTextChanged.connect(self._update_capacity_label)
+        self.packed12.toggled.connect(self._update_capacity_label)
+        self._update_capacity_label()
+
         port_layout = QtWidgets.QHBoxLayout()
         port_layout.addWidget(self.port_combo, 1)
         port_layout.addWidget(self.btn_refresh)
@@ -87,6 +247,8 @@ class SerialConfigDialog(QtWidgets.QDialog):
         form_layout.addRow("Bits de Parada:", self.stop_bits)
         form_layout.addRow("Paridad:", self.parity)
         form_layout.addRow("Timeout (ms):", self.timeout)
+        form_layout.addRow("Formato:", self.packed12)
+        form_layout.addRow("Capacidad:", self.capacity_label)
 
         btn_box = QtWidgets.QDialogButtonBox(
             QtWidgets.QDialogButtonBox.StandardButton.Ok |
@@ -99,13 +261,36 @@ class SerialConfigDialog(QtWidgets.QDialog):
         layout.addWidget(btn_box)
         self.setLayout(layout)
 
+    def _update_capacity_label(self, *_):
+        try:
+            baud = int(self.baud_combo.currentText())
+        except ValueError:
+            self.capacity_label.setText("-")
+            return
+        fs_max = max_rate_per_channel(baud, 8, self.packed12.isChecked())
+        self.capacity_label.setText(f"~{fs_max:.0f} Hz por canal con 8 canales")
+
+    def _on_refresh_clicked(self):
+        if self.port_monitor is not None:
+            self.port_monitor.refresh()     # el resultado llega por _check_ports_changed
+        else:
+            self.refresh_ports(self.port_combo.currentData())
+
+    def _check_ports_changed(self):
+        if self.port_monitor.version != self._ports_version:
+            self._ports_version = self.port_monitor.version
+            self.refresh_ports(self.port_combo.currentData())
+
     def refresh_ports(self, current_port_device=None):
         self.port_combo.clear()
         ports = []
-        try:
-            ports = serial.tools.list_ports.comports()
-        except Exception as e:
-             QtWidgets.QMessageBox.critical(self, "Error de Puertos", f"No se pudieron listar los puertos seriales:\n{e}")
+        if self.port_monitor is not None:
+            ports = list(self.port_monitor.ports)
+        else:
+            try:
+                ports = [(p.device, p.description or 'N/A') for p in serial.tools.list_ports.comports()]
+            except Exception as e:
+                 QtWidgets.QMessageBox.critical(self, "Error de Puertos", f"No se pudieron listar los puertos seriales:\n{e}")
 
         if not ports:
             self.port_combo.addItem("No hay puertos disponibles")
@@ -114,10 +299,9 @@ class SerialConfigDialog(QtWidgets.QDialog):
 
         self.port_combo.setEnabled(True)
         selected_index = 0
-        for i, port in enumerate(ports):
-            display_text = f"{port.device} ({port.description or 'N/A'})"
-            self.port_combo.addItem(display_text, port.device)
-            if current_port_device and port.device == current_port_device:
+        for i, (device, description) in enumerate(ports):
+            self.port_combo.addItem(f"{device} ({description})", device)
+            if current_port_device and device == current_port_device:
                 selected_index = i
 
         self.port_combo.setCurrentIndex(selected_index)
@@ -149,7 +333,8 @@ class SerialConfigDialog(QtWidgets.QDialog):
                 'bytesize': self.reverse_bytesize[selected_databits_text],
                 'stopbits': self.reverse_stopbits[selected_stopbits_text],
                 'parity': self.reverse_parity[selected_parity_text],
-                'timeout': timeout_val_sec
+                'timeout': timeout_val_sec,
+                'packed12': self.packed12.isChecked()
             }
             return config
         except KeyError as e:
@@ -176,19 +361,19 @@ class ChannelConfigDialog(QtWidgets.QDialog):
 
         # --- Tipo de Señal (0-2) 
         self.signal_type = QtWidgets.QComboBox()
-        self.signal_type.addItems(["Nativa", "Rectificada", "Envolvente"])  
+        self.signal_type.addItems(SIGNAL_TYPES)
 
         # --- Ganancia (0-2) ---
         self.gain = QtWidgets.QComboBox()
-        self.gain.addItems(["10", "25", "50"])
+        self.gain.addItems(GAINS)
 
         # --- Filtro Pasa Bajos (0-2) ---
         self.lowpass = QtWidgets.QComboBox()
-        self.lowpass.addItems(["15 Hz", "20 Hz", "25 Hz"]) 
+        self.lowpass.addItems(LOWPASS_VALUES)
 
         # --- Filtro Pasa Altos (0-2) ---
         self.highpass = QtWidgets.QComboBox()
-        self.highpass.addItems(["150 Hz", "350 Hz", "400 Hz"])  
+        self.highpass.addItems(HIGHPASS_VALUES)
 
         # --- Cargar valores iniciales ---
         self.channel.setValue(current_params.get("channel", 0))
@@ -226,6 +411,516 @@ class ChannelConfigDialog(QtWidgets.QDialog):
             "highpass": self.highpass.currentIndex()
         }
 
+class WelchConfigDialog(QtWidgets.QDialog):
+    """Parámetros del modo Welch: longitud de segmento, solapamiento y promedio exponencial."""
+    SEGMENT_LENGTHS = [64, 128, 256, 512, 1024, 2048, 4096]
+
+    def __init__(self, current_params, parent=None):
+        super().__init__(parent)
+        self.setWindowTitle("Espectro promediado (Welch)")
+        self.setMinimumWidth(350)
+
+        layout = QtWidgets.QVBoxLayout()
+        form_layout = QtWidgets.QFormLayout()
+
+        self.nperseg = QtWidgets.QComboBox()
+        self.nperseg.addItems([str(n) for n in self.SEGMENT_LENGTHS])
+        self.nperseg.setCurrentText(str(current_params.get('nperseg', 256)))
+
+        self.overlap = QtWidgets.QSpinBox()
+        self.overlap.setRange(0, 90)
+        self.overlap.setSuffix(" %")
+        self.overlap.setValue(int(round(100 * current_params.get('overlap', 0.5))))
+
+        self.alpha = QtWidgets.QDoubleSpinBox()
+        self.alpha.setRange(0.01, 1.0)
+        self.alpha.setSingleStep(0.05)
+        self.alpha.setDecimals(2)
+        self.alpha.setValue(current_params.get('alpha', 0.1))
+        self.alpha.setToolTip("Peso de cada segmento nuevo (1 = sin promedio; 0.1 ≈ últimos 10 segmentos).")
+
+        form_layout.addRow("Muestras por segmento:", self.nperseg)
+        form_layout.addRow("Solapamiento:", self.overlap)
+        form_layout.addRow("Promedio exponencial (alfa):", self.alpha)
+
+        btn_box = QtWidgets.QDialogButtonBox(
+            QtWidgets.QDialogButtonBox.StandardButton.Save |
+            QtWidgets.QDialogButtonBox.StandardButton.Close
+        )
+        btn_box.accepted.connect(self.accept)
+        btn_box.rejected.connect(self.reject)
+
+        layout.addLayout(form_layout)
+        layout.addWidget(btn_box)
+        self.setLayout(layout)
+
+    def get_config(self):
+        return {'nperseg': int(self.nperseg.currentText()),
+                'overlap': self.overlap.value() / 100.0,
+                'alpha': float(self.alpha.value())}
+
+
+class CrossChannelWindow(QtWidgets.QMainWindow):
+    """Coherencia y retardo entre todos los pares de canales, en vivo.
+
+    Lee las muestras nuevas del anillo del motor en cada refresco y las pasa a un
+    CrossSpectrum (mismos parámetros que el modo Welch).
+    """
+    REFRESH_MS = 500
+    NCH = 8
+
+    def __init__(self, main_window: 'RealTimePlot'):
+        super().__init__(main_window)
+        self.main = main_window
+        self.setWindowTitle("Análisis entre canales")
+        central = QtWidgets.QWidget()
+        self.setCentralWidget(central)
+        layout = QtWidgets.QVBoxLayout(central)
+        self.info_label = QtWidgets.QLabel("Esperando datos...")
+        layout.addWidget(self.info_label)
+
+        glw = pg.GraphicsLayoutWidget()
+        layout.addWidget(glw)
+        self.coh_img, self.lag_img = pg.ImageItem(), pg.ImageItem()
+        ticks = [[(i + 0.5, str(i)) for i in range(self.NCH)]]
+        for col, (img, title, cmap) in enumerate((
+                (self.coh_img, "Coherencia media (10 Hz - Nyquist)", 'viridis'),
+                (self.lag_img, "Retardo del pico de correlación (ms)", 'CET-D1'))):
+            plot = glw.addPlot(row=0, col=col, title=title)
+            plot.addItem(img)
+            plot.setAspectLocked(True)
+            plot.getAxis('bottom').setTicks(ticks)
+            plot.getAxis('left').setTicks(ticks)
+            plot.setLabel('bottom', 'Canal i')
+            plot.setLabel('left', 'Canal j')
+            img.setLookupTable(pg.colormap.get(cmap).getLookupTable())
+
+        self.spectrum = None
+        self._params = None
+        self._ring_total = 0
+        self._timer = QtCore.QTimer(self)
+        self._timer.timeout.connect(self._refresh)
+        self._timer.start(self.REFRESH_MS)
+
+    def _refresh(self):
+        main = self.main
+        fs = float(max(main.sampling_rate, 1))
+        params = (fs, tuple(sorted(main.welch_params.items())))
+        ring = main.engine.ring
+        if self.spectrum is None or params != self._params:
+            # Nuevo estimador (cambió fs o los parámetros de Welch): empieza desde ahora
+            self.spectrum = CrossSpectrum(fs, self.NCH, **main.welch_params)
+            self._params = params
+            self._ring_total = ring.total
+
+        raw, self._ring_total = ring.since(self._ring_total)
+        if len(raw):
+            self.spectrum.feed(raw[:, list(WIRE_COLUMN_OF_CHANNEL)].astype(np.float64))
+        if self.spectrum.csd is None:
+            return
+
+        coh = self.spectrum.coherence()
+        peak, lag = self.spectrum.cross_correlation()
+        lim_ms = 500.0 * self.spectrum.nperseg / fs
+        self.coh_img.setImage(coh, levels=(0.0, 1.0))
+        self.lag_img.setImage(lag * 1000.0, levels=(-lim_ms, lim_ms))
+        self.info_label.setText(f"{self.spectrum.segments} segmentos de {self.spectrum.nperseg} muestras "
+                                f"(retardo > 0: el canal j va detrás del i; rango ±{lim_ms:.0f} ms)")
+
+    def closeEvent(self, event: QtGui.QCloseEvent):
+        self._timer.stop()
+        event.accept()
+
+
+class CalibrationDialog(QtWidgets.QDialog):
+    """Calibración por canal: cero (entradas en corto) y ganancia con una referencia de RMS conocido.
+
+    Las capturas leen del anillo del motor durante 'Duración' sin bloquear la interfaz.
+    """
+    NCH = 8
+
+    def __init__(self, main_window: 'RealTimePlot'):
+        super().__init__(main_window)
+        self.main = main_window
+        self.cal = main_window.calibration
+        self.setWindowTitle("Calibración de Canales")
+        self.setMinimumWidth(520)
+
+        layout = QtWidgets.QVBoxLayout()
+        form_layout = QtWidgets.QFormLayout()
+        self.channel = QtWidgets.QComboBox()
+        self.channel.addItems(["Todos"] + [f"Canal {i}" for i in range(self.NCH)])
+        self.duration = QtWidgets.QDoubleSpinBox()
+        # El anillo del motor solo guarda RING_SECONDS: una captura más larga perdería el principio
+        self.duration.setRange(0.2, float(AcquisitionEngine.RING_SECONDS)); self.duration.setValue(2.0); self.duration.setSuffix(" s")
+        self.ref_uv = QtWidgets.QDoubleSpinBox()
+        self.ref_uv.setRange(1.0, 1e6); self.ref_uv.setDecimals(1); self.ref_uv.setValue(1000.0)
+        self.ref_uv.setSuffix(" µV RMS")
+        form_layout.addRow("Canales:", self.channel)
+        form_layout.addRow("Duración de la captura:", self.duration)
+        form_layout.addRow("Referencia en el electrodo:", self.ref_uv)
+        layout.addLayout(form_layout)
+
+        self.table = QtWidgets.QLabel()
+        self.table.setTextFormat(QtCore.Qt.TextFormat.RichText)
+        layout.addWidget(self.table)
+        self.status = QtWidgets.QLabel()
+        layout.addWidget(self.status)
+
+        buttons = QtWidgets.QHBoxLayout()
+        self.btn_zero = QtWidgets.QPushButton("Capturar cero")
+        self.btn_zero.setToolTip("Con las entradas en corto o en reposo: la media pasa a ser el cero.")
+        self.btn_zero.clicked.connect(lambda: self._start_capture('offset'))
+        self.btn_gain = QtWidgets.QPushButton("Capturar ganancia")
+        self.btn_gain.setToolTip("Con la señal de referencia aplicada: corrige la ganancia para que el RMS coincida.")
+        self.btn_gain.clicked.connect(lambda: self._start_capture('gain'))
+        btn_reset = QtWidgets.QPushButton("Restablecer")
+        btn_reset.clicked.connect(self._reset)
+        btn_save = QtWidgets.QPushButton("Guardar...")
+        btn_save.clicked.connect(self._save)
+        btn_load = QtWidgets.QPushButton("Cargar...")
+        btn_load.clicked.connect(self._load)
+        for b in (self.btn_zero, self.btn_gain, btn_reset, btn_save, btn_load):
+            buttons.addWidget(b)
+        layout.addLayout(buttons)
+
+        btn_box = QtWidgets.QDialogButtonBox(QtWidgets.QDialogButtonBox.StandardButton.Close)
+        btn_box.rejected.connect(self.reject)
+        layout.addWidget(btn_box)
+        self.setLayout(layout)
+        self._update_table()
+
+    def _channels(self):
+        idx = self.channel.currentIndex()
+        return list(range(self.NCH)) if idx == 0 else [idx - 1]
+
+    def _update_table(self):
+        rows = "".join(
+            f"<tr><td>{ch}</td><td>{self.cal.offset[ch]:.1f}{'' if self.cal.offset_captured[ch] else ' (nominal)'}</td>"
+            f"<td>{self.cal.gain[ch]:.4f}</td><td>{self.cal.amp_gain[ch]:g}</td></tr>"
+            for ch in range(self.NCH))
+        self.table.setText("<table cellspacing='6'><tr><th>Canal</th><th>Cero (cuentas)</th>"
+                           f"<th>Corrección</th><th>Ganancia amp.</th></tr>{rows}</table>")
+
+    def _start_capture(self, kind: str):
+        if not self.main.connected:
+            QtWidgets.QMessageBox.warning(self, "Error", "Conéctese al puerto serial primero.")
+            return
+        self.btn_zero.setEnabled(False); self.btn_gain.setEnabled(False)
+        self.status.setText("Capturando...")
+        start = self.main.engine.ring.total
+        QtCore.QTimer.singleShot(int(self.duration.value() * 1000), lambda: self._finish_capture(kind, start))
+
+    def _finish_capture(self, kind: str, start: int):
+        self.btn_zero.setEnabled(True); self.btn_gain.setEnabled(True)
+        raw, _ = self.main.engine.ring.since(start)
+        if len(raw) < 16:
+            self.status.setText("No llegaron datos durante la captura.")
+            return
+        chans = self._channels()
+        if kind == 'offset':
+            self.cal.capture_offset(raw, chans)
+        else:
+            self.cal.capture_gain(raw, self.ref_uv.value() * 1e-6, chans)
+        self.status.setText(f"Captura de {'cero' if kind == 'offset' else 'ganancia'}: {len(raw)} muestras.")
+        self._update_table()
+        self.main._on_calibration_changed()
+
+    def _reset(self):
+        amp = self.cal.amp_gain.copy()
+        self.cal.reset()
+        # Se conservan las ganancias de amplificador y el offset nominal de los canales
+        # configurados; los demás quedan con la calibración identidad
+        for ch, st in enumerate(self.main.channel_states):
+            if st.get('configured'):
+                self.cal.set_channel_config(ch, amp[ch], st.get('tipo') in (None, SIGNAL_TYPES[0]))
+        self.cal.set_display(self.main.scale_factor, self.main.display_offset_volts)
+        self._update_table()
+        self.main._on_calibration_changed()
+
+    def _save(self):
+        path, _ = QtWidgets.QFileDialog.getSaveFileName(self, "Guardar calibración", "calibracion.json", "Calibración (*.json)")
+        if not path:
+            return
+        try:
+            self.cal.save(path)
+        except OSError as e:
+            QtWidgets.QMessageBox.critical(self, "Error", f"No se pudo guardar la calibración:\n{e}")
+
+    def _load(self):
+        path, _ = QtWidgets.QFileDialog.getOpenFileName(self, "Cargar calibración", "", "Calibración (*.json)")
+        if not path:
+            return
+        try:
+            self.cal.load(path)
+        except (OSError, ValueError, KeyError) as e:
+            QtWidgets.QMessageBox.critical(self, "Error", f"No se pudo cargar la calibración:\n{e}")
+            return
+        self._update_table()
+        self.main._on_calibration_changed()
+
+
+class TriggeredWindow(QtWidgets.QMainWindow):
+    """Modo disparado: ventanas pre/post alrededor de cada disparo y promedio de ensayos.
+
+    Funciona a la vez que la vista continua: el TriggeredCapture es un sink más del motor.
+    """
+    REFRESH_MS = 100
+    NCH = 8
+
+    def __init__(self, main_window: 'RealTimePlot'):
+        super().__init__(main_window)
+        self.main = main_window
+        self.capture = None
+        self._fs = None
+        self.setWindowTitle("Captura disparada y promedio de ensayos")
+        central = QtWidgets.QWidget()
+        self.setCentralWidget(central)
+        layout = QtWidgets.QVBoxLayout(central)
+
+        controls = QtWidgets.QHBoxLayout()
+        self.channel = QtWidgets.QComboBox()
+        self.channel.addItems([f"Canal {i}" for i in range(self.NCH)])
+        self.source = QtWidgets.QComboBox()
+        self.source.addItems(["Umbral", "Solo marcas"])
+        self.threshold = QtWidgets.QDoubleSpinBox()
+        self.threshold.setRange(-1000.0 * main_window.v_ref, 1000.0 * main_window.v_ref)
+        self.threshold.setDecimals(3)
+        self.threshold.setSingleStep(0.05)
+        self.threshold.setSuffix(" mV")
+        self.threshold.setValue(0.5)
+        self.threshold.setToolTip("Umbral en el electrodo (unidades calibradas).")
+        self.edge = QtWidgets.QComboBox()
+        self.edge.addItems(["Subida", "Bajada"])
+        self.pre_ms = QtWidgets.QSpinBox()
+        self.pre_ms.setRange(0, 2000); self.pre_ms.setValue(100); self.pre_ms.setSuffix(" ms pre")
+        self.post_ms = QtWidgets.QSpinBox()
+        self.post_ms.setRange(1, 5000); self.post_ms.setValue(400); self.post_ms.setSuffix(" ms post")
+        self.holdoff_ms = QtWidgets.QSpinBox()
+        self.holdoff_ms.setRange(0, 10000); self.holdoff_ms.setValue(500); self.holdoff_ms.setSuffix(" ms espera")
+        self.holdoff_ms.setToolTip("Tiempo tras un disparo durante el que no se vuelve a disparar.")
+        self.mode = QtWidgets.QComboBox()
+        self.mode.addItems(["Continuo", "Único"])
+        for w in (self.channel, self.source, self.threshold, self.edge,
+                  self.pre_ms, self.post_ms, self.holdoff_ms, self.mode):
+            controls.addWidget(w)
+
+        self.btn_arm = QtWidgets.QPushButton("Armar")
+        self.btn_arm.setToolTip("Aplica la configuración, reinicia el promedio y arma el disparo.")
+        self.btn_arm.clicked.connect(self._rebuild_capture)
+        self.btn_mark = QtWidgets.QPushButton("Marca")
+        self.btn_mark.setToolTip("Disparo manual (marca externa) en la muestra actual.")
+        self.btn_mark.clicked.connect(self._mark)
+        for w in (self.btn_arm, self.btn_mark):
+            controls.addWidget(w)
+        layout.addLayout(controls)
+
+        self.info_label = QtWidgets.QLabel()
+        layout.addWidget(self.info_label)
+
+        glw = pg.GraphicsLayoutWidget()
+        layout.addWidget(glw)
+        self.mean_curves, self.last_curves = [], []
+        for ch in range(self.NCH):
+            plot = glw.addPlot(row=ch // 4, col=ch % 4, title=f"Canal {ch}")
+            plot.showGrid(x=True, y=True)
+            plot.addItem(pg.InfiniteLine(pos=0.0, angle=90, movable=False, pen=pg.mkPen('r')))
+            self.last_curves.append(plot.plot(pen=pg.mkPen((150, 150, 150), width=1)))
+            self.mean_curves.append(plot.plot(pen=pg.mkPen('y', width=2)))
+            if ch // 4 == 1:
+                plot.setLabel('bottom', 'Tiempo desde el disparo (ms)')
+
+        self._timer = QtCore.QTimer(self)
+        self._timer.timeout.connect(self._refresh)
+        self._timer.start(self.REFRESH_MS)
+        self._rebuild_capture()
+
+    def _rebuild_capture(self):
+        main = self.main
+        fs = float(max(main.sampling_rate, 1))
+        ch = self.channel.currentIndex()
+        try:
+            capture = TriggeredCapture(
+                main.engine.ring, WIRE_COLUMN_OF_CHANNEL[ch],
+                main.calibration.to_counts(ch, self.threshold.value() * 1e-3),
+                pre=int(round(self.pre_ms.value() * fs / 1000.0)),
+                post=int(round(self.post_ms.value() * fs / 1000.0)),
+                rising=self.edge.currentIndex() == 0,
+                holdoff=int(round(self.holdoff_ms.value() * fs / 1000.0)),
+                single=self.mode.currentIndex() == 1,
+                use_threshold=self.source.currentIndex() == 0)
+        except ValueError as e:
+            QtWidgets.QMessageBox.warning(self, "Error de Configuración", str(e))
+            return
+        self._detach()
+        self.capture = capture
+        self._fs = fs
+        self._t_ms = (np.arange(capture.pre + capture.post) - capture.pre) * 1000.0 / fs
+        main.engine.add_sink(capture)
+
+    def _detach(self):
+        if self.capture is not None:
+            self.main.engine.remove_sink(self.capture)
+            self.capture = None
+
+    def _mark(self):
+        if self.capture is not None:
+            self.capture.mark()
+
+    def _refresh(self):
+        if self.capture is None:
+            return
+        if self._fs != float(max(self.main.sampling_rate, 1)):
+            self._rebuild_capture()     # cambió el perfil: las ventanas en muestras ya no valen
+            return
+        mean, last, trials = self.capture.snapshot()
+        state = "armado" if self.capture.armed else "desarmado"
+        self.info_label.setText(f"Ensayos: {trials} | perdidos: {self.capture.missed} | {state}")
+        if not trials:
+            return
+        cal = self.main.calibration
+        mean_v, last_v = cal.apply(mean), cal.apply(last)
+        for ch in range(self.NCH):
+            self.mean_curves[ch].setData(self._t_ms, mean_v[:, ch])
+            self.last_curves[ch].setData(self._t_ms, last_v[:, ch])
+
+    def closeEvent(self, event: QtGui.QCloseEvent):
+        self._timer.stop()
+        self._detach()
+        event.accept()
+
+
+class SessionReviewWindow(QtWidgets.QMainWindow):
+    """Revisión de un registro .emgz: zoom desde la sesión completa hasta muestras individuales."""
+    MAX_POINTS = 2000     # cubetas min/max por traza
+    RAW_SAMPLES = 4000    # por debajo se dibujan las muestras reales
+
+    def __init__(self, path: str, main_window: 'RealTimePlot'):
+        super().__init__(main_window)
+        self.main = main_window
+        self.reader = EMGZReader(path)
+        self.overview = EMGOverview(self.reader)
+        fs = float(max(self.reader.fs, 1.0))
+        self.duration = max(self.reader.n_samples / fs, 1e-3)
+
+        self.setWindowTitle(f"Revisión de Sesión - {os.path.basename(path)}")
+        central = QtWidgets.QWidget()
+        self.setCentralWidget(central)
+        layout = QtWidgets.QVBoxLayout(central)
+
+        controls = QtWidgets.QHBoxLayout()
+        self.info_label = QtWidgets.QLabel()
+        controls.addWidget(self.info_label)
+        controls.addStretch()
+        self.fft_ch_combo = QtWidgets.QComboBox()
+        self.fft_ch_combo.addItems([f"Canal {i}" for i in range(self.reader.nch)])
+        controls.addWidget(self.fft_ch_combo)
+        self.btn_fft = QtWidgets.QPushButton("FFT del rango")
+        self.btn_fft.setToolTip("FFT del canal seleccionado sobre el rango visible.")
+        self.btn_fft.clicked.connect(self._open_range_fft)
+        controls.addWidget(self.btn_fft)
+        layout.addLayout(controls)
+
+        self.plots, self.curves = [], []
+        for ch in range(self.reader.nch):
+            pw = pg.PlotWidget(title=f"Canal {ch}")
+            pw.setLabel('left', 'Voltaje (V)', units='V')
+            pw.showGrid(x=True, y=True)
+            pw.enableAutoRange(x=False, y=True)
+            pw.setLimits(xMin=0.0, xMax=self.duration)
+            if self.plots:
+                pw.setXLink(self.plots[0])
+            curve = pw.plot(pen=pg.mkPen('y', width=1))
+            layout.addWidget(pw)
+            self.plots.append(pw)
+            self.curves.append(curve)
+        self.plots[-1].setLabel('bottom', 'Tiempo (s)')
+
+        # Re-dibujo diferido al hacer zoom/pan (agrupa eventos seguidos)
+        self._render_timer = QtCore.QTimer(self)
+        self._render_timer.setSingleShot(True)
+        self._render_timer.setInterval(30)
+        self._render_timer.timeout.connect(self._render)
+        self.plots[0].sigXRangeChanged.connect(lambda *_: self._render_timer.start())
+
+        # Mientras se construye la pirámide, refresca la vista periódicamente
+        self._progress_timer = QtCore.QTimer(self)
+        self._progress_timer.timeout.connect(self._on_overview_progress)
+        self._progress_timer.start(250)
+
+        self.plots[0].setXRange(0.0, self.duration, padding=0)
+        self._update_info()
+        self._render()
+
+    def _update_info(self):
+        text = (f"{self.reader.nch} canales · {self.reader.fs:.0f} Hz · "
+                f"{self.reader.n_samples} muestras ({self.duration:.1f} s) · "
+                f"{'V en el electrodo (calibrado)' if self.reader.calibration is not None else 'V del ADC (sin calibrar)'}")
+        if not self.overview.ready:
+            text += f" · índice {self.overview.chunks_done}/{self.reader.n_chunks}"
+        self.info_label.setText(text)
+
+    def _on_overview_progress(self):
+        self._update_info()
+        self._render()
+        if self.overview.ready:
+            self._progress_timer.stop()
+
+    def _visible_samples(self):
+        x0, x1 = self.plots[0].viewRange()[0]
+        fs = float(self.reader.fs)
+        start = max(int(np.floor(x0 * fs)), 0)
+        stop = min(int(np.ceil(x1 * fs)) + 1, self.reader.n_samples)
+        return start, stop
+
+    def _render(self):
+        start, stop = self._visible_samples()
+        if stop - start < 2:
+            for c in self.curves:
+                c.clear()
+            return
+        fs = float(self.reader.fs)
+
+        if stop - start <= self.RAW_SAMPLES:
+            # Muestras reales: mismo trazado que la vista en vivo
+            raw = self.reader.read(start, stop)
+            x = np.arange(start, stop, dtype=np.float64) / fs
+            for ch, curve in enumerate(self.curves):
+                self.main._draw_trace(curve, x, self.reader.volts(raw, ch))
+            return
+
+        starts, mn, mx = self.overview.envelope(start, stop, self.MAX_POINTS)
+        x = np.repeat(starts / fs, 2)
+        for ch, curve in enumerate(self.curves):
+            # La calibración es lineal creciente: min/max de cuentas -> min/max en V
+            y = np.empty(2 * len(starts), dtype=np.float64)
+            y[0::2] = self.reader.volts(mn, ch)
+            y[1::2] = self.reader.volts(mx, ch)
+            curve.setData(x, y, connect='finite')
+
+    def _open_range_fft(self):
+        ch = self.fft_ch_combo.currentIndex()
+        start, stop = self._visible_samples()
+        # Limita la FFT a 2^16 muestras centradas en la vista
+        if stop - start > 65536:
+            mid = (start + stop) // 2
+            start, stop = mid - 32768, mid + 32768
+        y = self.reader.volts(self.reader.read(start, stop), ch)
+        f, mag = self.main._compute_fft_bilateral(y - np.mean(y) if len(y) else y, float(self.reader.fs))
+        if f is None:
+            return
+        win = pg.plot(title=f"FFT Canal {ch} ({start / self.reader.fs:.2f}-{stop / self.reader.fs:.2f} s)")
+        win.setAttribute(QtCore.Qt.WidgetAttribute.WA_DeleteOnClose)
+        win.setLabel('bottom', 'Frecuencia (Hz)')
+        win.setLabel('left', 'Magnitud (dB)')
+        win.plot(f, 20*np.log10(np.maximum(mag, 1e-12)), pen=pg.mkPen('c', width=2))
+
+    def closeEvent(self, event: QtGui.QCloseEvent):
+        self._progress_timer.stop()
+        self.overview.stop()
+        self.reader.close()
+        event.accept()
+
 class RealTimePlot(QtWidgets.QMainWindow):
     def __init__(self):
         super().__init__()
@@ -252,6 +947,7 @@ class RealTimePlot(QtWidgets.QMainWindow):
         # contenedor vertical para 8 cajas
         self.channel_cards = []     # lista de QFrames por canal 0..7
         self.channel_titles = []    # titulo canal
+        self.channel_freq_labels = []   # frecuencia media/mediana (modo Welch)
 
         for ch in range(8):
             card = QtWidgets.QFrame()
@@ -262,6 +958,9 @@ class RealTimePlot(QtWidgets.QMainWindow):
             title = QtWidgets.QLabel(f"Canal {ch}")
             title.setStyleSheet("font-weight: 600;")
             v.addWidget(title)
+            freq = QtWidgets.QLabel("")
+            freq.setVisible(False)
+            v.addWidget(freq)
 
             # Tooltip inicial
             card.setToolTip("Canal no configurado")
@@ -270,6 +969,7 @@ class RealTimePlot(QtWidgets.QMainWindow):
             left_layout.addWidget(card)
             self.channel_cards.append(card)
             self.channel_titles.append(title)
+            self.channel_freq_labels.append(freq)
 
         left_layout.addStretch(1)
 
@@ -320,6 +1020,64 @@ class RealTimePlot(QtWidgets.QMainWindow):
         self.btn_fft.clicked.connect(self._on_fft_open_clicked)
         control_layout.addWidget(self.btn_fft)
 
+        self.spectrum_combo = QtWidgets.QComboBox()
+        self.spectrum_combo.addItems(["Periodograma", "Welch (promediado)"])
+        self.spectrum_combo.setToolTip("Periodograma de la ventana visible o PSD de Welch con frecuencia media/mediana.")
+        self.spectrum_combo.currentIndexChanged.connect(self._on_spectrum_mode_changed)
+        control_layout.addWidget(self.spectrum_combo)
+
+        self.btn_welch = QtWidgets.QPushButton("Welch...")
+        self.btn_welch.setToolTip("Longitud de segmento, solapamiento y promedio del modo Welch.")
+        self.btn_welch.clicked.connect(self._show_welch_dialog)
+        control_layout.addWidget(self.btn_welch)
+
+        self.btn_cross = QtWidgets.QPushButton("Coherencia")
+        self.btn_cross.setToolTip("Coherencia y retardo entre todos los pares de canales.")
+        self.btn_cross.clicked.connect(self._open_cross_channel_window)
+        control_layout.addWidget(self.btn_cross)
+        self.cross_windows = []
+
+        self.btn_calibration = QtWidgets.QPushButton("Calibrar...")
+        self.btn_calibration.setToolTip("Cero y ganancia por canal; unidades en el electrodo.")
+        self.btn_calibration.clicked.connect(self._show_calibration_dialog)
+        control_layout.addWidget(self.btn_calibration)
+
+        self.btn_trigger = QtWidgets.QPushButton("Disparo")
+        self.btn_trigger.setToolTip("Captura disparada por umbral o marca, con promedio de ensayos.")
+        self.btn_trigger.clicked.connect(self._open_triggered_window)
+        control_layout.addWidget(self.btn_trigger)
+        self.trigger_windows = []
+
+        # --- Perfil de adquisición (fs, ventana y FFT) ---
+        self.profile_combo = QtWidgets.QComboBox()
+        self.profile_combo.addItems(list(ACQ_PROFILES.keys()))
+        self.profile_combo.setCurrentText(DEFAULT_ACQ_PROFILE)
+        self.profile_combo.setToolTip("Frecuencia de muestreo, ventana visible y tamaño de FFT.")
+        self.profile_combo.currentTextChanged.connect(self._apply_acquisition_profile)
+        control_layout.addWidget(self.profile_combo)
+
+        # --- Grabación comprimida ---
+        self.btn_record = QtWidgets.QPushButton("Grabar")
+        self.btn_record.setToolTip("Grabar la sesión en formato comprimido (.emgz).")
+        self.btn_record.clicked.connect(self._toggle_recording)
+        control_layout.addWidget(self.btn_record)
+
+        self.btn_export = QtWidgets.QPushButton("Exportar")
+        self.btn_export.setToolTip("Exportar en vivo a EDF+/BDF+/HDF5.")
+        self.btn_export.clicked.connect(self._toggle_export)
+        control_layout.addWidget(self.btn_export)
+
+        self.btn_convert = QtWidgets.QPushButton("Convertir...")
+        self.btn_convert.setToolTip("Convertir registros .emgz existentes a EDF+/BDF+/HDF5.")
+        self.btn_convert.clicked.connect(self._convert_recordings)
+        control_layout.addWidget(self.btn_convert)
+
+        self.btn_review = QtWidgets.QPushButton("Revisar sesión")
+        self.btn_review.setToolTip("Abrir un registro .emgz para revisarlo.")
+        self.btn_review.clicked.connect(self._open_review_window)
+        control_layout.addWidget(self.btn_review)
+        self.review_windows = []
+
         right_layout.addLayout(control_layout) 
 
         # --- Rejilla dinámica para las gráficas ---
@@ -333,72 +1091,61 @@ class RealTimePlot(QtWidgets.QMainWindow):
 
         self._plots_rows_used = 0  
 
-        # Crear las 8 gráficas
-        self.plot_chA = pg.PlotWidget(title="Canal 0"); self.curve_chA = self.plot_chA.plot(pen=pg.mkPen('y', width=2))
-        self.plot_chB = pg.PlotWidget(title="Canal 1"); self.curve_chB = self.plot_chB.plot(pen=pg.mkPen('y', width=2))
-        self.plot_chC = pg.PlotWidget(title="Canal 2"); self.curve_chC = self.plot_chC.plot(pen=pg.mkPen('y', width=2))
-        self.plot_chD = pg.PlotWidget(title="Canal 3"); self.curve_chD = self.plot_chD.plot(pen=pg.mkPen('y', width=2))
-        self.plot_chE = pg.PlotWidget(title="Canal 4"); self.curve_chE = self.plot_chE.plot(pen=pg.mkPen('y', width=2))
-        self.plot_chF = pg.PlotWidget(title="Canal 5"); self.curve_chF = self.plot_chF.plot(pen=pg.mkPen('y', width=2))
-        self.plot_chG = pg.PlotWidget(title="Canal 6"); self.curve_chG = self.plot_chG.plot(pen=pg.mkPen('y', width=2))
-        self.plot_chH = pg.PlotWidget(title="Canal 7"); self.curve_chH = self.plot_chH.plot(pen=pg.mkPen('y', width=2))
-
-        for c in [self.curve_chA, self.curve_chB, self.curve_chC, self.curve_chD,
-                self.curve_chE, self.curve_chF, self.curve_chG, self.curve_chH]:
-            c.setClipToView(True)
-            # Cuando haya muchos puntos en pantalla, pyqtgraph “subsamplea” para que no se serruche
-            c.setDownsampling(auto=True, method='subsample')
-
-        # Configuración común de ejes
-        for pw in [self.plot_chA, self.plot_chB, self.plot_chC, self.plot_chD, self.plot_chE, self.plot_chF, self.plot_chG, self.plot_chH]:
-            pw.setLabel('left', 'Voltaje (V)', units='V')
-            pw.setLabel('bottom', 'Tiempo (s)')
-            pw.showGrid(x=True, y=True)
-            pw.hide()  # Ocultas al inicio
-
-        # Lista para manejar dinámicamente
-        self.plot_widgets = [
-            self.plot_chA, self.plot_chB, self.plot_chC, self.plot_chD,
-            self.plot_chE, self.plot_chF, self.plot_chG, self.plot_chH
-]
+        # Las gráficas se crean al configurar cada canal (_ensure_plot): el arranque no
+        # paga pyqtgraph ni 8 PlotWidget que la mayoría de sesiones no usa
+        self.plot_widgets = [None] * 8
+        self.plot_curves = [None] * 8
 
 
         # Parámetros de conversión
         self.v_ref = 3.3
         self.max_adc = 4095
-        self.points_to_show = 50
-        self.upsample_factor = 4
         self.scale_factor = 1.0
         self.display_offset_volts = 0.0
+        # Calibración por canal (cero, corrección y ganancia del amplificador) -> V en el electrodo
+        self.calibration = ChannelCalibration(self.v_ref, self.max_adc)
+        self.calibration.set_display(self.scale_factor, self.display_offset_volts)
         self.smooth_enabled = False
         self.smooth_window  = 7    
 
-        from collections import deque
-        self.dataA = deque(maxlen=self.points_to_show)
-        self.dataB = deque(maxlen=self.points_to_show)
-        self.dataC = deque(maxlen=self.points_to_show)
-        self.dataD = deque(maxlen=self.points_to_show)
-        self.dataE = deque(maxlen=self.points_to_show)
-        self.dataF = deque(maxlen=self.points_to_show)
-        self.dataG = deque(maxlen=self.points_to_show)
-        self.dataH = deque(maxlen=self.points_to_show)
+        # Parámetros del perfil de adquisición (los fija _apply_acquisition_profile)
+        self.acq_profile = DEFAULT_ACQ_PROFILE
+        prof = ACQ_PROFILES[DEFAULT_ACQ_PROFILE]
+        self.sampling_rate = prof['sampling_rate']
+        self.points_to_show = prof['points_to_show']
+        self.upsample_factor = prof['upsample_factor']
+        self.fft_size = prof['fft_size']
+        self._fft_refresh_ms = prof['fft_refresh_ms']
+
+        self._y_track = [_YRangeTracker(self.points_to_show) for _ in range(8)]
+        # Periodo de muestreo medido (ClockSync del motor); el eje X lo usa en lugar del nominal
+        self._sample_period = 1.0 / self.sampling_rate
+        # PSD de Welch incremental (solo en modo Welch; la alimenta _ingest_block)
+        self.welch_params = {'nperseg': 256, 'overlap': 0.5, 'alpha': 0.1}
+        self._welch = None
 
-        # Buffer para ensamblar frames del puerto serie
-        self.buffer = bytearray()
-        self.FRAME_HDR = b'\xA5\x5A'
+        self._alloc_channel_buffers(self.points_to_show)
+        self._plot_channel_idx = {}
+        self._rebuild_x_cache()
+        self._fft_plans = {}
+
+        # Motor de adquisición (hilo lector + decodificador); la GUI consume su cola
+        self.engine = AcquisitionEngine(self.acq_profile)
+        self._engine_queue = self.engine.subscribe()
 
 
         # Inicializar Parámetros
         self.channel_params = { "channel": 0, "gain": 0, "lowpass": 0, "highpass": 0, "signal_type": 0 }
-        initial_port = None
-        try:
-            available_ports = serial.tools.list_ports.comports()
-            if available_ports: initial_port = available_ports[0].device
-        except Exception as e: print(f"[ERROR] Error al detectar puerto inicial: {e}")
+        # Descubrimiento de puertos en segundo plano; el inicial se elige al primer sondeo
+        self.port_monitor = PortMonitor()
+        self._ports_version = 0
 
-        self.serial_params = { 'port': initial_port, 'baudrate': 115200, 'bytesize': serial.EIGHTBITS, 'stopbits': serial.STOPBITS_ONE, 'parity': serial.PARITY_NONE, 'timeout': 0.05 }
-        self.ser = None
+        self.serial_params = { 'port': None, 'baudrate': 115200, 'bytesize': serial.EIGHTBITS, 'stopbits': serial.STOPBITS_ONE, 'parity': serial.PARITY_NONE, 'timeout': 0.05, 'packed12': False }
         self.connected = False
+        self._reconnect_shown = False
+        self._wire_shown = None         # formato de cable reflejado en status_label
+        self.recorder = None
+        self.exporter = None
 
 
         # Timer
@@ -406,44 +1153,77 @@ class RealTimePlot(QtWidgets.QMainWindow):
         self.timer.setInterval(50) 
         self.timer.timeout.connect(self.update_plot)
 
+        self._ports_timer = QtCore.QTimer(self)
+        self._ports_timer.timeout.connect(self._on_ports_changed)
+        self._ports_timer.start(500)
+
         self.update_status_label()
         self._update_channel_labels()
     
-
-        self.sampling_rate = 600
         self._apply_plot_limits()
 
         # --- FFT 
         self.fft_windows = {} 
-        self._fft_refresh_ms = 200
 
-        #  timer 
+        #  timer (arranca con la primera ventana FFT)
         self._fft_timer = QtCore.QTimer(self)
+        self._fft_timer.setInterval(self._fft_refresh_ms)
         self._fft_timer.timeout.connect(self._refresh_all_ffts)
-        self._fft_timer.start(self._fft_refresh_ms)
+
+        # Pool para el cálculo espectral: en la GUI solo queda el setData (ver _get_fft_pool)
+        self._fft_workers = 2
+        self._fft_pool = None
+        self._fft_seq = 0
+        self._fft_applied_seq = {}
+        self._fft_in_flight = 0
+        self._fft_bridge = _FFTResultBridge()
+        self._fft_bridge.ready.connect(self._on_fft_batch_ready)
 
         self.logo_izq = QtWidgets.QLabel(self)
-        pixmap_izq = QtGui.QPixmap(u"C:/Users/57323/Downloads/logo-ub-b.png")
-        pixmap_izq = pixmap_izq.scaled(110, 110, QtCore.Qt.AspectRatioMode.KeepAspectRatio)
-        self.logo_izq.setPixmap(pixmap_izq)
         self.logo_izq.setFixedSize(110, 110)
         self.logo_izq.setAlignment(QtCore.Qt.AlignmentFlag.AlignLeft | QtCore.Qt.AlignmentFlag.AlignTop)
+        # La imagen se lee del disco con la ventana ya visible
+        QtCore.QTimer.singleShot(0, self._load_logo)
 
 
         self.logo_izq.raise_()  
 
+    def _load_logo(self):
+        pixmap_izq = QtGui.QPixmap(u"C:/Users/57323/Downloads/logo-ub-b.png")
+        pixmap_izq = pixmap_izq.scaled(110, 110, QtCore.Qt.AspectRatioMode.KeepAspectRatio)
+        self.logo_izq.setPixmap(pixmap_izq)
+
     def resizeEvent(self, event):
         super().resizeEvent(event)
         # Logo inferior izquierdo
         self.logo_izq.move(30, self.height() - self.logo_izq.height() - 150)  
 
 
+    def _on_ports_changed(self):
+        """Conexión en caliente: propone el primer puerto si no hay ninguno elegido."""
+        mon = self.port_monitor
+        if mon.version == self._ports_version:
+            return
+        self._ports_version = mon.version
+        if mon.error is not None:
+            print(f"[ERROR] Error al listar puertos: {mon.error}")
+        devices = [d for d, _ in mon.ports]
+        if not self.connected and self.serial_params.get('port') not in devices and devices:
+            self.serial_params['port'] = devices[0]
+        if not self.connected:
+            self.update_status_label()
+
     def update_status_label(self):
 
         if self.connected:
             port = self.serial_params.get('port', 'N/A')
             baud = self.serial_params.get('baudrate', 'N/A')
-            self.status_label.setText(f"Conectado a {port} ({baud})")
+            # Formato según los frames recibidos, no según el comando enviado (no hay confirmación)
+            wire = self.engine.wire_packed
+            fmt = wire_format_name(wire)
+            if self.engine.packed_requested and wire is False:
+                fmt += " - el STM32 no aplicó el formato de 12 bits"
+            self.status_label.setText(f"Conectado a {port} ({baud}, {fmt})")
         else:
             port = self.serial_params.get('port', 'N/A')
             baud = self.serial_params.get('baudrate', 'N/A')
@@ -457,7 +1237,7 @@ class RealTimePlot(QtWidgets.QMainWindow):
 
     def show_config_dialog(self):
 
-        dialog = SerialConfigDialog(self.serial_params, self)
+        dialog = SerialConfigDialog(self.serial_params, self, port_monitor=self.port_monitor)
         dialog_result = dialog.exec()
 
         if dialog_result == QtWidgets.QDialog.DialogCode.Accepted:
@@ -493,18 +1273,11 @@ class RealTimePlot(QtWidgets.QMainWindow):
              self.update_status_label()
              return
 
-        if self.ser and self.ser.is_open:
-            try: self.ser.close()
-            except Exception as e: print(f"[WARN] [RealTimePlot] Advertencia: Error al cerrar puerto existente: {e}")
-
         try:
-            self.ser = serial.Serial(**self.serial_params)
-
-            self.ser.reset_input_buffer()
-            self.ser.reset_output_buffer()
+            self.engine.open(self.serial_params)
 
             # Limpia buffers para el nuevo framing de 2 canales
-            self.buffer.clear()
+            self._drain_engine_queue()
             self.dataA.clear()
             self.dataB.clear()
             self.dataC.clear()
@@ -513,39 +1286,37 @@ class RealTimePlot(QtWidgets.QMainWindow):
             self.dataF.clear()
             self.dataG.clear()
             self.dataH.clear()
+            for tracker in self._y_track:
+                tracker.clear()
+            self._reset_welch()
 
 
             self.connected = True
             self.btn_connect.setText("Desconectar")
             self.connection_indicator.setStyleSheet("background-color: green; border-radius: 10px;")
 
-            self.curve_chA.clear()
-            self.curve_chB.clear()
-            self.curve_chC.clear()
-            self.curve_chD.clear()
-            self.curve_chE.clear()
-            self.curve_chF.clear()
-            self.curve_chG.clear()
-            self.curve_chH.clear()
+            for curve in self.plot_curves:
+                if curve is not None:
+                    curve.clear()
     
 
             self.timer.start()
 
 
         except serial.SerialException as e:
-            self.connected = False; self.ser = None
+            self.connected = False
             error_msg = f"No se pudo conectar a {self.serial_params.get('port', 'N/A')}:\n{str(e)}"
             QtWidgets.QMessageBox.critical(self, "Error de Conexión", error_msg)
             self.connection_indicator.setStyleSheet("background-color: red; border-radius: 10px;")
             self.btn_connect.setText("Conectar"); self.timer.stop()
         except (TypeError, ValueError) as e:
-             self.connected = False; self.ser = None
+             self.connected = False
              error_msg = f"Parámetros seriales inválidos ({type(e).__name__}):\n{str(e)}\n\nVerifique la configuración."
              QtWidgets.QMessageBox.critical(self, "Error de Parámetros", error_msg)
              self.connection_indicator.setStyleSheet("background-color: red; border-radius: 10px;")
              self.btn_connect.setText("Conectar"); self.timer.stop()
         except Exception as e:
-            self.connected = False; self.ser = None
+            self.connected = False
             error_msg = f"Ocurrió un error inesperado ({type(e).__name__}) al conectar:\n{str(e)}"
             QtWidgets.QMessageBox.critical(self, "Error Inesperado", error_msg)
             self.connection_indicator.setStyleSheet("background-color: red; border-radius: 10px;")
@@ -563,13 +1334,10 @@ class RealTimePlot(QtWidgets.QMainWindow):
     def _disconnect_serial(self):
 
         self.timer.stop()
-        if self.ser and self.ser.is_open:
-            try:
-                self.ser.close()
-            except Exception as e:
-                print(f"[ERROR] [RealTimePlot] Error al cerrar el puerto {self.serial_params.get('port', '')}: {e}")
+        self._stop_recording()
+        self._stop_export()
+        self.engine.close()
 
-        self.ser = None
         self.connected = False
         self.btn_connect.setText("Conectar")
         self.connection_indicator.setStyleSheet("background-color: red; border-radius: 10px;")
@@ -596,15 +1364,33 @@ class RealTimePlot(QtWidgets.QMainWindow):
             plot.setRange(xRange=(0.0, max(1.0 / max(self.sampling_rate, 1), 1e-3)), padding=0)
             return
 
-        fs = float(self.sampling_rate)
-        x = (np.arange(n, dtype=np.float64) / fs)
+        x = self._x_base[:n]
         y = np.asarray(data, dtype=np.float64)
 
+        # Con la ventana llena se reutiliza el eje denso precalculado
+        self._draw_trace(curve, x, y, self._x_dense if n == len(self._x_base) else None)
+
+        # Rango Y: solo se toca el ViewBox cuando la señal sale de la banda
+        ch = self._plot_channel_idx.get(plot)
+        y_range = self._y_track[ch].update_range() if ch is not None else None
+        if y_range is not None:
+            plot.setYRange(*y_range, padding=0)
+
+        # Rango X:  points_to_show y periodo medido
+        duration = max(len(data) * self._sample_period, 1e-3)
+        max_seconds = max(self.points_to_show * self._sample_period, 1e-3)
+        plot.setRange(xRange=(0.0, min(duration, max_seconds)), padding=0)
+
+
+    def _draw_trace(self, curve, x: np.ndarray, y: np.ndarray, x_dense: np.ndarray = None):
+        """Sobremuestreo + suavizado opcional + setData (también lo usa la revisión de sesiones)."""
+        n = len(x)
         # --- Upsample (interpolación lineal solo para dibujar) ---
         k = int(getattr(self, "upsample_factor", 1))
         if k > 1:
-            x_dense = np.linspace(x[0], x[-1], n * k, dtype=np.float64)
-            y_dense = np.interp(x_dense, x, y).astype(np.float64)
+            if x_dense is None:
+                x_dense = np.linspace(x[0], x[-1], n * k, dtype=np.float64)
+            y_dense = np.interp(x_dense, x, y)
         else:
             x_dense, y_dense = x, y
 
@@ -615,11 +1401,68 @@ class RealTimePlot(QtWidgets.QMainWindow):
         # Dibujar
         curve.setData(x_dense, y_dense)
 
-        # Rango X:  points_to_show y fs
-        duration = max(len(data) / max(self.sampling_rate, 1.0), 1e-3)
-        max_seconds = max(self.points_to_show / max(self.sampling_rate, 1.0), 1e-3)
-        plot.setRange(xRange=(0.0, min(duration, max_seconds)), padding=0)
+    def _alloc_channel_buffers(self, maxlen: int):
+        """(Re)crea los 8 deques con 'maxlen', conservando la cola de datos existente."""
+        names = ['dataA', 'dataB', 'dataC', 'dataD', 'dataE', 'dataF', 'dataG', 'dataH']
+        for name in names:
+            old = getattr(self, name, None)
+            setattr(self, name, deque(old if old is not None else (), maxlen=maxlen))
+        # Extremos deslizantes por canal sobre la misma ventana que los deques
+        for tracker in self._y_track:
+            tracker.set_window(maxlen)
+
+    def _rebuild_x_cache(self):
+        """Eje X de la ventana completa (y su versión sobremuestreada) para no recalcularlo cada tick."""
+        n = int(self.points_to_show)
+        self._x_base = np.arange(n, dtype=np.float64) * self._sample_period
+        k = int(self.upsample_factor)
+        if k > 1 and n >= 2:
+            self._x_dense = np.linspace(self._x_base[0], self._x_base[-1], n * k, dtype=np.float64)
+        else:
+            self._x_dense = self._x_base
+
+    def _get_fft_plan(self, N: int, fs: float):
+        """Ventana Hann, nfft y eje de frecuencias cacheados por (N, fs)."""
+        key = (N, fs)
+        plan = self._fft_plans.get(key)
+        if plan is None:
+            win = np.hanning(N).astype(np.float64)
+            nfft = max(int(self.fft_size), 1 << int(np.ceil(np.log2(N))))
+            f_shift = np.fft.fftshift(np.fft.fftfreq(nfft, d=1.0/fs))
+            plan = {'win': win, 'nfft': nfft, 'f': f_shift, 'norm': np.sum(win) / 2.0 + 1e-12}
+            # Mientras la ventana se llena N cambia en cada tick: acota la caché
+            if len(self._fft_plans) > 32:
+                self._fft_plans.clear()
+            self._fft_plans[key] = plan
+        return plan
+
+    def _apply_acquisition_profile(self, name: str):
+        """Cambia fs, ventana visible y FFT en caliente; redimensiona buffers y cachés."""
+        prof = ACQ_PROFILES.get(name)
+        if prof is None:
+            return
 
+        self.acq_profile = name
+        self.engine.set_profile(name)
+        self.sampling_rate = prof['sampling_rate']
+        self.upsample_factor = prof['upsample_factor']
+        self.fft_size = prof['fft_size']
+        self._fft_refresh_ms = prof['fft_refresh_ms']
+        self._sample_period = 1.0 / self.sampling_rate
+
+        if prof['points_to_show'] != self.points_to_show:
+            self.points_to_show = prof['points_to_show']
+            self._alloc_channel_buffers(self.points_to_show)
+
+        # Cachés dependientes de fs / ventana: se recalculan aquí, fuera del tick
+        self._rebuild_x_cache()
+        self._fft_plans.clear()
+        if self.fft_windows:
+            self._get_fft_plan(self.points_to_show, float(self.sampling_rate))
+
+        self._fft_timer.setInterval(self._fft_refresh_ms)
+        self._apply_plot_limits()
+        self._reset_welch()
 
     def _get_channel_data_array(self, ch_idx: int) -> np.ndarray:
         # Devuelve el deque del canal como ndarray float64
@@ -653,12 +1496,20 @@ class RealTimePlot(QtWidgets.QMainWindow):
             w.show(); w.raise_(); w.activateWindow()
             return
 
+        if not self._fft_timer.isActive():
+            self._fft_timer.start()
+
         # Crear ventana y curva
         win = pg.plot(title=f"FFT Canal {ch_idx}")
+        win.setAttribute(QtCore.Qt.WidgetAttribute.WA_DeleteOnClose)
         win.setLabel('bottom', 'Frecuencia (Hz)')
         win.setLabel('left', 'Magnitud')
         curve = win.plot(pen=pg.mkPen('c', width=2))
-        self.fft_windows[ch_idx] = {'win': win, 'curve': curve}
+        # Marca de la frecuencia mediana (solo en modo Welch)
+        mdf_line = pg.InfiniteLine(angle=90, movable=False, pen=pg.mkPen('y', style=QtCore.Qt.PenStyle.DashLine))
+        mdf_line.setVisible(self._welch is not None)
+        win.addItem(mdf_line)
+        self.fft_windows[ch_idx] = {'win': win, 'curve': curve, 'mdf_line': mdf_line}
 
         # Cuando la ventana se destruya, la sacamos del dict (persistencia controlada)
         def on_destroyed():
@@ -671,28 +1522,77 @@ class RealTimePlot(QtWidgets.QMainWindow):
         if N < 4 or fs <= 0:
             return None, None
 
-        # Ventana Hann y zero-padding a potencia de 2
-        win = np.hanning(N).astype(np.float64)
-        yw = (y.astype(np.float64) * win)
-        nfft = 1 << int(np.ceil(np.log2(N)))
+        # Ventana Hann y zero-padding a potencia de 2 (plan cacheado)
+        plan = self._get_fft_plan(N, fs)
 
-        # FFT bilateral 
-        Y = fft.fft(yw, n=nfft)
-        f = fft.fftfreq(nfft, d=1.0/fs)
-        Y_shift = fft.fftshift(Y)
-        f_shift = fft.fftshift(f)
+        # FFT bilateral, magnitud normalizada
+        mag = _fft_mag_batch(y[None, :], plan)[0]
+        return plan['f'], mag
 
-        # Magnitud normalizada
-    
-        mag = np.abs(Y_shift) / (np.sum(win) / 2.0 + 1e-12)
-        return f_shift, mag
+    def _on_spectrum_mode_changed(self, index: int):
+        self._reset_welch()
+        for ch_idx, info in self.fft_windows.items():
+            info['curve'].clear()
+            info['mdf_line'].setVisible(self._welch is not None)
+            info['win'].setTitle(f"FFT Canal {ch_idx}")
+
+    def _show_welch_dialog(self):
+        dialog = WelchConfigDialog(self.welch_params, self)
+        if dialog.exec() == QtWidgets.QDialog.DialogCode.Accepted:
+            self.welch_params = dialog.get_config()
+            self._reset_welch()
+
+    def _reset_welch(self):
+        """(Re)crea el estimador de Welch si el modo está activo; se descarta el promedio."""
+        if self.spectrum_combo.currentIndex() == 1:
+            self._welch = WelchPSD(float(max(self.sampling_rate, 1)), 8, **self.welch_params)
+            # Las tarjetas muestran MNF/MDF aunque no haya ventanas FFT abiertas
+            if not self._fft_timer.isActive():
+                self._fft_timer.start()
+        else:
+            self._welch = None
+        for label in self.channel_freq_labels:
+            label.setVisible(False)
+
+    def _refresh_welch_windows(self):
+        """Pinta la PSD promediada (dB V²/Hz) y la frecuencia media/mediana de cada canal.
+
+        MNF/MDF van también a las tarjetas de canal, abiertas o no las ventanas FFT.
+        """
+        welch = self._welch
+        if welch.psd is None:
+            return
+        mean_f, median_f = welch.frequencies()
+        for ch_idx, label in enumerate(self.channel_freq_labels):
+            show = self.channel_states[ch_idx]['configured'] and np.isfinite(median_f[ch_idx])
+            if show:
+                label.setText(f"MNF {mean_f[ch_idx]:.1f} Hz | MDF {median_f[ch_idx]:.1f} Hz")
+            label.setVisible(bool(show))
+        psd_db = 10 * np.log10(np.maximum(welch.psd, 1e-20))
+        for ch_idx, info in list(self.fft_windows.items()):
+            if not self.channel_states[ch_idx]['configured']:
+                info['curve'].clear()
+                continue
+            info['curve'].setData(welch.f, psd_db[ch_idx])
+            info['win'].setLabel('left', 'PSD (dB V²/Hz)')
+            info['win'].setTitle(f"PSD Canal {ch_idx} - media {mean_f[ch_idx]:.1f} Hz, "
+                                 f"mediana {median_f[ch_idx]:.1f} Hz ({welch.segments} segm.)")
+            if np.isfinite(median_f[ch_idx]):
+                info['mdf_line'].setPos(float(median_f[ch_idx]))
 
     def _refresh_all_ffts(self): #Refresca las ventanas FFT abiertas
+        if self._welch is not None:
+            self._refresh_welch_windows()
+            return
         if not self.fft_windows:
             return
+        # Si el pool va atrasado no se encolan más lotes (se descartaría igual)
+        if self._fft_in_flight >= 2 * self._fft_workers:
+            return
 
         fs = float(max(self.sampling_rate, 1.0))
-        # Recorre canales abiertos
+        # Agrupa los canales abiertos por longitud: cada grupo es una FFT en lote
+        groups = {}
         for ch_idx, info in list(self.fft_windows.items()):
             # Solo si el canal está configurado y con datos
             if not self.channel_states[ch_idx]['configured']:
@@ -703,189 +1603,327 @@ class RealTimePlot(QtWidgets.QMainWindow):
             if y is None:
                 info['curve'].clear()
                 continue
+            groups.setdefault(len(y), []).append((ch_idx, y))
+
+        self._fft_seq += 1
+        for N, items in groups.items():
+            plan = self._get_fft_plan(N, fs)
+            # Reparte el grupo entre los workers
+            step = -(-len(items) // self._fft_workers)
+            for i in range(0, len(items), step):
+                part = items[i:i + step]
+                chans = [ch for ch, _ in part]
+                Y = np.stack([y for _, y in part])
+                fut = self._get_fft_pool().submit(_fft_db_job, self._fft_seq, chans, Y, plan)
+                self._fft_in_flight += 1
+                fut.add_done_callback(self._emit_fft_result)
+
+    def _get_fft_pool(self) -> ThreadPoolExecutor:
+        """Pool del cálculo espectral, creado con el primer lote de FFT."""
+        if self._fft_pool is None:
+            self._fft_pool = ThreadPoolExecutor(max_workers=self._fft_workers, thread_name_prefix="fft")
+        return self._fft_pool
+
+    def _emit_fft_result(self, fut):
+        # Hilo del pool: solo reenvía a la GUI
+        try:
+            self._fft_bridge.ready.emit(fut.result())
+        except Exception as e:
+            self._fft_bridge.ready.emit(e)
 
-        
-            y = y - np.mean(y)
-
-            f, mag = self._compute_fft_bilateral(y, fs)
-            mag = 20*np.log10(np.maximum(mag, 1e-12))
-            info['curve'].setData(f, mag)
+    def _on_fft_batch_ready(self, result):
+        self._fft_in_flight = max(self._fft_in_flight - 1, 0)
+        if isinstance(result, Exception):
+            print(f"[ERROR] Error en cálculo FFT: {result}")
+            return
+        if self._welch is not None:
+            return      # periodograma pedido antes de cambiar a modo Welch
+        seq, chans, f, mag_db = result
+        for row, ch_idx in enumerate(chans):
+            info = self.fft_windows.get(ch_idx)
+            # Descarta resultados más viejos que el último ya pintado
+            if info is None or seq <= self._fft_applied_seq.get(ch_idx, 0):
+                continue
+            self._fft_applied_seq[ch_idx] = seq
+            info['curve'].setData(f, mag_db[row])
             info['win'].setLabel('left', 'Magnitud (dB)')
 
 
     def update_plot(self):
-        if not self.connected or not self.ser or not self.ser.is_open:
+        if not self.connected:
             return
 
-        try:
-            # 1) Leer lo disponible (no bloquear) y acumular en buffer
-            if self.ser.in_waiting > 0:
-                self.buffer.extend(self.ser.read(self.ser.in_waiting))
-
-            # 2) Decodificar algunos frames por tick (evita tirones)
-            decoded = 0
-            MAX_FRAMES_PER_TICK = 3  # ajusta 2..5 si quieres
+        # El motor reintenta la conexión por su cuenta; aquí solo se refleja el estado
+        err = self.engine.take_error()
+        if err is not None:
+            self._disconnect_serial()
+            self.status_label.setText(f"Conexión perdida: {err}")
+            return
+        if self.engine.reconnecting:
+            if not self._reconnect_shown:
+                self._reconnect_shown = True
+                self.connection_indicator.setStyleSheet("background-color: orange; border-radius: 10px;")
+                self.status_label.setText(f"Reconectando a {self.engine.port}...")
+            return
+        gaps = self.engine.take_gaps()
+        if gaps or self._reconnect_shown:
+            self._reconnect_shown = False
+            self.serial_params['port'] = self.engine.port
+            self.connection_indicator.setStyleSheet("background-color: green; border-radius: 10px;")
+            self.update_status_label()
+            if gaps:
+                gap_s = sum(g[0] for g in gaps)
+                self.status_label.setText(f"{self.status_label.text()} - reconectado (hueco de {gap_s:.1f} s)")
+        if self.engine.wire_packed != self._wire_shown:
+            self._wire_shown = self.engine.wire_packed
+            self.update_status_label()
 
+        try:
+            # 1) Consumir los bloques que decodificó el motor desde el último tick
+            ts = None
             while True:
-                # Mínimo: hdr(2) + nch(1) + nsamp(2) + seq(2) + chk(1) + al menos 2 bytes de datos
-                if len(self.buffer) < 8:
-                    break
-
-                # Buscar cabecera A5 5A
-                hdr_idx = self.buffer.find(self.FRAME_HDR)
-                if hdr_idx == -1:
-                    # no hay cabecera aún: descarta basura acumulada
-                    self.buffer.clear()
-                    break
-
-                # Descartar bytes previos a la cabecera
-                if hdr_idx > 0:
-                    del self.buffer[:hdr_idx]
-
-                # Ya tenemos al menos header + nch + nsamp + seq?
-                if len(self.buffer) < 7:  # 2 (hdr) + 1 (nch) + 2 (nsamp) + 2 (seq)
-                    break
-
-                nch   = self.buffer[2]  # u8
-                nsamp = int.from_bytes(self.buffer[3:5], 'little', signed=False)  # u16
-                # seq = int.from_bytes(self.buffer[5:7], 'little', signed=False)   # opcional
-
-                # Validación rápida de nch para evitar reshape raros
-                if nch == 0 or nch > 8:
-                    # valor imposible → resincroniza
-                    del self.buffer[0]
-                    continue
-
-                data_bytes = nch * nsamp * 2
-                total_len  = 2 + 1 + 2 + 2 + data_bytes + 1  # hdr + nch + nsamp + seq + data + chk
-
-                # Esperar a que llegue el frame completo
-                if len(self.buffer) < total_len:
+                try:
+                    seq, arr, ts = self._engine_queue.get_nowait()
+                except queue.Empty:
                     break
+                self._ingest_block(arr)
 
-                # Extraer frame
-                frame = bytes(self.buffer[:total_len])
-
-                # Checksum (suma de todo salvo el último byte)
-                if (sum(frame[:-1]) & 0xFF) != frame[-1]:
-                    # byte corrupto → avanza 1 y reintenta
-                    del self.buffer[0]
-                    continue
+            # 2) Pintar una vez por tick
+            if ts is not None:
+                self._track_sample_period(ts[1])
+                self._paint_channels()
 
-                # Payload: quitar hdr(2), nch(1), nsamp(2), seq(2) y chk(1)
-                payload = frame[7:-1]
+        except Exception as e:
+            print("[ERROR] Excepción en update_plot:")
+            traceback.print_exc()
+            self.status_label.setText(f"Error: {type(e).__name__}")
 
-                # Convertir a matriz (nsamp, nch) de u16 LE
-                try:
-                    arr = np.frombuffer(payload, dtype='<u2').reshape(-1, nch)
-                except ValueError:
-                    # si por alguna razón no calza, resincroniza 1 byte
-                    del self.buffer[0]
-                    continue
-
-                # 3) Convertir a voltios aplicando factor de escala
-                scale = (self.v_ref / self.max_adc)
-
-                # Siempre hay canal A
-                chA = arr[:, 0].astype(np.float32) * scale
-                # Conditional para B, C, D (si llegan)
-                chB = arr[:, 1].astype(np.float32) * scale if nch >= 2 else None
-                chC = arr[:, 2].astype(np.float32) * scale if nch >= 3 else None
-                chD = arr[:, 3].astype(np.float32) * scale if nch >= 4 else None
-                chE = arr[:, 6].astype(np.float32) * scale if nch >= 7 else None
-                chF = arr[:, 5].astype(np.float32) * scale if nch >= 6 else None
-                chG = arr[:, 4].astype(np.float32) * scale if nch >= 5 else None
-                chH = arr[:, 7].astype(np.float32) * scale if nch >= 8 else None
-
-                # 4) Acumular en buffers circulares
-                if self.channel_states[0]['configured']: self.dataA.extend(chA.tolist())
-                if chB is not None and self.channel_states[1]['configured']: self.dataB.extend(chB.tolist())
-                if chC is not None and self.channel_states[2]['configured']: self.dataC.extend(chC.tolist())
-                if chD is not None and self.channel_states[3]['configured']: self.dataD.extend(chD.tolist())
-                if chE is not None and self.channel_states[4]['configured']: self.dataE.extend(chE.tolist())
-                if chF is not None and self.channel_states[5]['configured']: self.dataF.extend(chF.tolist())
-                if chG is not None and self.channel_states[6]['configured']: self.dataG.extend(chG.tolist())
-                if chH is not None and self.channel_states[7]['configured']: self.dataH.extend(chH.tolist())
-
-                # Consumir frame del buffer
-                del self.buffer[:total_len]
-
-                decoded += 1
-                if decoded >= MAX_FRAMES_PER_TICK:
-                    break
+    def _track_sample_period(self, period: float):
+        """Adopta el periodo medido si se separa más de 10 ppm del que usa el eje X."""
+        if abs(period / self._sample_period - 1.0) <= 10e-6:
+            return
+        self._sample_period = period
+        self._rebuild_x_cache()
+        clock = self.engine.clock
+        self.status_label.setToolTip(f"fs medida: {1.0 / period:.3f} Hz "
+                                     f"(deriva {clock.drift_ppm:+.1f} ppm respecto a {clock.fs_nominal:g} Hz)")
+
+    def _drain_engine_queue(self):
+        while True:
+            try:
+                self._engine_queue.get_nowait()
+            except queue.Empty:
+                return
+
+    def _ingest_block(self, arr: np.ndarray):
+        """Bloque (nsamp, nch) de cuentas ADC -> voltios en el electrodo en los deques de cada canal."""
+        nch = arr.shape[1]
+
+        # Calibración de todo el bloque en un producto-suma: (n, 8) en orden de canal
+        volts = self.calibration.apply(arr)
+
+        # Siempre hay canal A
+        chA = volts[:, 0]
+        # Conditional para B, C, D (si llegan)
+        chB = volts[:, 1] if nch >= 2 else None
+        chC = volts[:, 2] if nch >= 3 else None
+        chD = volts[:, 3] if nch >= 4 else None
+        chE = volts[:, 4] if nch >= 7 else None
+        chF = volts[:, 5] if nch >= 6 else None
+        chG = volts[:, 6] if nch >= 5 else None
+        chH = volts[:, 7] if nch >= 8 else None
+
+        # Acumular en buffers circulares (y en los extremos deslizantes del canal)
+        buffers = (self.dataA, self.dataB, self.dataC, self.dataD, self.dataE, self.dataF, self.dataG, self.dataH)
+        for ch, (buf, vals) in enumerate(zip(buffers, (chA, chB, chC, chD, chE, chF, chG, chH))):
+            if vals is not None and self.channel_states[ch]['configured']:
+                buf.extend(vals.tolist())
+                self._y_track[ch].extend(vals)
+
+        # Welch: los segmentos se calculan al completarse, sobre el flujo y no sobre la ventana
+        if self._welch is not None:
+            self._welch.feed(volts)
+
+    def _paint_channels(self):
+        # --- Pintado en orden: TOP (A,C,E,F) ; BOTTOM (B,D,G,H)
+        buffers = (self.dataA, self.dataB, self.dataC, self.dataD,
+                   self.dataE, self.dataF, self.dataG, self.dataH)
+        for ch in (0, 2, 4, 5, 1, 3, 6, 7):
+            curve = self.plot_curves[ch]
+            if curve is None:
+                continue    # canal nunca configurado: su gráfica aún no existe
+            if self.channel_states[ch]['configured'] and len(buffers[ch]) > 0:
+                self._plot_channel(buffers[ch], curve, self.plot_widgets[ch])
+            else:
+                curve.clear()
 
-                # --- Pintado en orden: TOP (A,C,E,F) ; BOTTOM (B,D,G,H)
-                if self.channel_states[0]['configured'] and len(self.dataA) > 0:
-                    self._plot_channel(self.dataA, self.curve_chA, self.plot_chA)
-                else:
-                    self.curve_chA.clear()
+    def _toggle_recording(self):
+        if self.recorder is not None:
+            self._stop_recording()
+            return
+        if not self.connected:
+            QtWidgets.QMessageBox.warning(self, "Error", "Conéctese al puerto serial primero.")
+            return
 
-                if self.channel_states[2]['configured'] and len(self.dataC) > 0:
-                    self._plot_channel(self.dataC, self.curve_chC, self.plot_chC)
-                else:
-                    self.curve_chC.clear()
+        path, _ = QtWidgets.QFileDialog.getSaveFileName(
+            self, "Guardar registro", "sesion.emgz", "Registro EMG comprimido (*.emgz)")
+        if not path:
+            return
+        try:
+            self.recorder = EMGRecorder(EMGZWriter(path, 8, self.sampling_rate, self.v_ref, self.max_adc,
+                                                   calibration=self.calibration.electrode_coeffs()))
+            self.engine.add_sink(self.recorder)
+        except OSError as e:
+            QtWidgets.QMessageBox.critical(self, "Error de Grabación", f"No se pudo crear el archivo:\n{e}")
+            return
 
-                if self.channel_states[4]['configured'] and len(self.dataE) > 0:
-                    self._plot_channel(self.dataE, self.curve_chE, self.plot_chE)
-                else:
-                    self.curve_chE.clear()
+        # La fs queda fija en la cabecera: no se cambia de perfil mientras se graba
+        self.profile_combo.setEnabled(False)
+        self.btn_record.setText("Detener grabación")
 
-                
-                if self.channel_states[5]['configured'] and len(self.dataF) > 0:
-                    self._plot_channel(self.dataF, self.curve_chF, self.plot_chF)
-                else:
-                    self.curve_chF.clear()
+    def _stop_recording(self):
+        if self.recorder is None:
+            return
+        rec, self.recorder = self.recorder, None
+        self.engine.remove_sink(rec)
+        rec.stop()
+        self.profile_combo.setEnabled(self.exporter is None)
+        self.btn_record.setText("Grabar")
+        if rec.error is not None:
+            QtWidgets.QMessageBox.warning(self, "Error de Grabación",
+                                          f"La grabación terminó con errores:\n{rec.error}")
+
+    def _channel_metadata(self):
+        return [dict(st) for st in self.channel_states]
+
+    def _toggle_export(self):
+        if self.exporter is not None:
+            self._stop_export()
+            return
+        if not self.connected:
+            QtWidgets.QMessageBox.warning(self, "Error", "Conéctese al puerto serial primero.")
+            return
 
+        path, fmt = QtWidgets.QFileDialog.getSaveFileName(
+            self, "Exportar sesión", "sesion.edf", ";;".join(EXPORT_FORMATS.keys()))
+        if not path or fmt not in EXPORT_FORMATS:
+            return
+        ext, factory = EXPORT_FORMATS[fmt]
+        if not path.lower().endswith(ext):
+            path += ext
+        try:
+            writer = factory(path, 8, self.sampling_rate, self.v_ref, self.max_adc, self._channel_metadata(),
+                             self.calibration.electrode_coeffs())
+            self.exporter = EMGRecorder(writer)
+            self.engine.add_sink(self.exporter)
+        except (OSError, RuntimeError) as e:
+            QtWidgets.QMessageBox.critical(self, "Error de Exportación", f"No se pudo iniciar la exportación:\n{e}")
+            return
 
-                if self.channel_states[1]['configured'] and len(self.dataB) > 0:
-                    self._plot_channel(self.dataB, self.curve_chB, self.plot_chB)
-                else:
-                    self.curve_chB.clear()
+        self.profile_combo.setEnabled(False)
+        self.btn_export.setText("Detener exportación")
 
-                if self.channel_states[3]['configured'] and len(self.dataD) > 0:
-                    self._plot_channel(self.dataD, self.curve_chD, self.plot_chD)
-                else:
-                    self.curve_chD.clear()
+    def _stop_export(self):
+        if self.exporter is None:
+            return
+        exp, self.exporter = self.exporter, None
+        self.engine.remove_sink(exp)
+        exp.stop()
+        self.profile_combo.setEnabled(self.recorder is None)
+        self.btn_export.setText("Exportar")
+        if exp.error is not None:
+            QtWidgets.QMessageBox.warning(self, "Error de Exportación",
+                                          f"La exportación terminó con errores:\n{exp.error}")
+
+    def _convert_recordings(self):
+        paths, _ = QtWidgets.QFileDialog.getOpenFileNames(
+            self, "Registros a convertir", "", "Registro EMG comprimido (*.emgz)")
+        if not paths:
+            return
+        fmt, ok = QtWidgets.QInputDialog.getItem(
+            self, "Formato de salida", "Formato:", list(EXPORT_FORMATS.keys()), 0, False)
+        if not ok:
+            return
 
-                if self.channel_states[6]['configured'] and len(self.dataG) > 0:
-                    self._plot_channel(self.dataG, self.curve_chG, self.plot_chG)
-                else:
-                    self.curve_chG.clear()
+        progress = QtWidgets.QProgressDialog("Convirtiendo registros...", "Cancelar", 0, len(paths), self)
+        progress.setWindowModality(QtCore.Qt.WindowModality.WindowModal)
 
+        def on_chunk(done, total):
+            QtWidgets.QApplication.processEvents()
+            return not progress.wasCanceled()
 
-                if self.channel_states[7]['configured'] and len(self.dataH) > 0:
-                    self._plot_channel(self.dataH, self.curve_chH, self.plot_chH)
-                else:
-                    self.curve_chH.clear()
+        errors = []
+        for i, src in enumerate(paths):
+            progress.setValue(i)
+            progress.setLabelText(f"Convirtiendo {os.path.basename(src)}...")
+            dst = os.path.splitext(src)[0] + EXPORT_FORMATS[fmt][0]
+            try:
+                # El .emgz no guarda la configuración de canales: se exporta sin metadatos
+                convert_recording(src, dst, fmt, None, on_chunk)
+            except (OSError, ValueError, RuntimeError, struct.error) as e:
+                errors.append(f"{os.path.basename(src)}: {e}")
+            if progress.wasCanceled():
+                break
+        progress.setValue(len(paths))
+
+        if errors:
+            QtWidgets.QMessageBox.warning(self, "Error de Conversión", "\n".join(errors))
+
+    def _open_review_window(self):
+        path, _ = QtWidgets.QFileDialog.getOpenFileName(
+            self, "Abrir registro", "", "Registro EMG comprimido (*.emgz)")
+        if not path:
+            return
+        try:
+            win = SessionReviewWindow(path, self)
+        except (OSError, ValueError, struct.error) as e:
+            QtWidgets.QMessageBox.critical(self, "Error de Lectura", f"No se pudo abrir el registro:\n{e}")
+            return
+        win.resize(1100, 800)
+        win.show()
+        self._track_child_window(self.review_windows, win)
+
+    def _open_cross_channel_window(self):
+        win = CrossChannelWindow(self)
+        win.resize(1000, 500)
+        win.show()
+        self._track_child_window(self.cross_windows, win)
+
+    def _track_child_window(self, windows: list, win):
+        """Mantiene 'win' en 'windows' mientras exista (se destruye al cerrarse)."""
+        # Al cerrarse se destruye (con sus timers y gráficas) en vez de quedar oculta
+        win.setAttribute(QtCore.Qt.WidgetAttribute.WA_DeleteOnClose)
+        windows.append(win)
+        win.destroyed.connect(lambda *_: windows.remove(win) if win in windows else None)
+
+    def _show_calibration_dialog(self):
+        CalibrationDialog(self).exec()
+
+    def _on_calibration_changed(self):
+        """Los datos ya en pantalla están en las unidades anteriores: se descartan."""
+        for ch in range(8):
+            self._clear_channel_buffer(ch)
+        self._reset_welch()
 
-        except serial.SerialException as e:
-            QtWidgets.QMessageBox.warning(self, "Error de Lectura",
-                                        f"Se perdió la conexión o hubo un error:\n{str(e)}")
-            self._disconnect_serial()
-        except Exception as e:
-            print("[ERROR] Excepción en update_plot:")
-            traceback.print_exc()
-            self.status_label.setText(f"Error: {type(e).__name__}")
+    def _open_triggered_window(self):
+        win = TriggeredWindow(self)
+        win.resize(1200, 600)
+        win.show()
+        self._track_child_window(self.trigger_windows, win)
 
     def _set_channel_state_card(self, ch_index: int, signal_type_idx: int, gain_idx: int, lp_idx: int, hp_idx: int):
 
         if not (0 <= ch_index < 8):
             return
 
-        # Mapear índices a textos (ajusta a tus opciones reales si difieren)
-        signal_types   = ["Nativa", "Rectificada", "Envolvente"]
-        gains          = ["10", "25", "50"]
-        lowpass_values = ["15 Hz", "20 Hz", "25 Hz"]
-        highpass_values= ["150 Hz", "350 Hz", "400 Hz"]
-
-        tipo = signal_types[signal_type_idx] if 0 <= signal_type_idx < len(signal_types) else str(signal_type_idx)
-        gain = gains[gain_idx]               if 0 <= gain_idx        < len(gains)        else str(gain_idx)
-        lp   = lowpass_values[lp_idx]        if 0 <= lp_idx          < len(lowpass_values) else str(lp_idx)
-        hp   = highpass_values[hp_idx]       if 0 <= hp_idx          < len(highpass_values) else str(hp_idx)
-
-        # Guardar estado
+        # Mapear índices a textos y guardar estado
+        desc = describe_channel_config(signal_type_idx, gain_idx, lp_idx, hp_idx)
         st = self.channel_states[ch_index]
-        st.update({'configured': True, 'tipo': tipo, 'gain': gain, 'lp': lp, 'hp': hp})
+        st.update(desc)
+        # Compensa la ganancia del amplificador; cero nominal a media escala si la señal es bipolar
+        amp_gain = float(GAINS[gain_idx]) if 0 <= gain_idx < len(GAINS) else 1.0
+        self.calibration.set_channel_config(ch_index, amp_gain, bipolar=signal_type_idx == 0)
+        tipo, gain, lp, hp = desc['tipo'], desc['gain'], desc['lp'], desc['hp']
 
         # Tooltip en HTML (multilínea)
         tip_html = (
@@ -923,7 +1961,7 @@ class RealTimePlot(QtWidgets.QMainWindow):
         # 2) Colocación regular: 2 por fila. El último (si n impar) se expande a dos columnas.
         rows = (n + 1) // 2  # filas necesarias
         for idx, ch in enumerate(configured):
-            pw = self.plot_widgets[ch]
+            pw = self._ensure_plot(ch)
             pw.setSizePolicy(QtWidgets.QSizePolicy.Policy.Expanding,
                             QtWidgets.QSizePolicy.Policy.Expanding)
 
@@ -949,28 +1987,61 @@ class RealTimePlot(QtWidgets.QMainWindow):
 
         self._plots_rows_used = rows
 
-    def _apply_plot_limits(self):
+    def _ensure_plot(self, ch: int):
+        """PlotWidget del canal 'ch'; se crea (con su curva) la primera vez que se pide."""
+        pw = self.plot_widgets[ch]
+        if pw is None:
+            pw = pg.PlotWidget(title=f"Canal {ch}")
+            curve = pw.plot(pen=pg.mkPen('y', width=2))
+            curve.setClipToView(True)
+            # Cuando haya muchos puntos en pantalla, pyqtgraph “subsamplea” para que no se serruche
+            curve.setDownsampling(auto=True, method='subsample')
+            pw.setLabel('left', 'Voltaje (V)', units='V')
+            pw.setLabel('bottom', 'Tiempo (s)')
+            pw.showGrid(x=True, y=True)
+            pw.hide()
+            self._set_plot_limits(pw)
+            self.plot_widgets[ch] = pw
+            self.plot_curves[ch] = curve
+            self._plot_channel_idx[pw] = ch
+        return pw
+
+    def _set_plot_limits(self, pw):
         max_seconds = max(self.points_to_show / max(self.sampling_rate, 1), 1e-3)
-        for pw in [self.plot_chA, self.plot_chB, self.plot_chC, self.plot_chD,
-                self.plot_chE, self.plot_chF, self.plot_chG, self.plot_chH]:
-            pw.enableAutoRange(x=False, y=True)             # X manual, Y auto
-            pw.setLimits(xMin=0.0, xMax=float(max_seconds)) # límites finitos
-            pw.setRange(xRange=(0.0, float(max_seconds)), padding=0)
+        pw.enableAutoRange(x=False, y=False)            # X manual, Y por _YRangeTracker
+        pw.setLimits(xMin=0.0, xMax=float(max_seconds)) # límites finitos
+        pw.setRange(xRange=(0.0, float(max_seconds)), padding=0)
+
+    def _apply_plot_limits(self):
+        for pw in self.plot_widgets:
+            if pw is not None:
+                self._set_plot_limits(pw)
+        for tracker in self._y_track:
+            tracker.range = None    # el próximo repintado vuelve a fijar el rango Y
 
 
     def _clear_channel_buffer(self, ch: int):
-        if ch == 0:  self.dataA.clear(); self.curve_chA.clear()
-        elif ch == 1: self.dataB.clear(); self.curve_chB.clear()
-        elif ch == 2: self.dataC.clear(); self.curve_chC.clear()
-        elif ch == 3: self.dataD.clear(); self.curve_chD.clear()
-        elif ch == 4: self.dataE.clear(); self.curve_chE.clear()
-        elif ch == 5: self.dataF.clear(); self.curve_chF.clear()
-        elif ch == 6: self.dataG.clear(); self.curve_chG.clear()
-        elif ch == 7: self.dataH.clear(); self.curve_chH.clear()
+        if 0 <= ch < len(self._y_track):
+            self._y_track[ch].clear()
+        if ch == 0:  self.dataA.clear()
+        elif ch == 1: self.dataB.clear()
+        elif ch == 2: self.dataC.clear()
+        elif ch == 3: self.dataD.clear()
+        elif ch == 4: self.dataE.clear()
+        elif ch == 5: self.dataF.clear()
+        elif ch == 6: self.dataG.clear()
+        elif ch == 7: self.dataH.clear()
+        if 0 <= ch < len(self.plot_curves) and self.plot_curves[ch] is not None:
+            self.plot_curves[ch].clear()
 
 
     def closeEvent(self, event: QtGui.QCloseEvent):
         self._disconnect_serial()
+        self._fft_timer.stop()
+        if self._fft_pool is not None:
+            self._fft_pool.shutdown(wait=False, cancel_futures=True)
+        self._ports_timer.stop()
+        self.port_monitor.stop()
         event.accept()
 
 
@@ -1004,19 +2075,15 @@ class RealTimePlot(QtWidgets.QMainWindow):
             )
 
     def _send_command_to_stm(self):
-        if not self.connected or not self.ser or not self.ser.is_open:
+        if not self.connected or not (self.engine.is_open or self.engine.reconnecting):
              QtWidgets.QMessageBox.warning(self,"Error","No hay conexión serial activa para enviar comando.")
              return
         try:
-            cmd = (
-                f"{self.channel_params['channel']}"
-                f"{self.channel_params['gain']}"
-                f"{self.channel_params['lowpass']}"
-                f"{self.channel_params['highpass']}"
-                f"{self.channel_params['signal_type']}"
-            )
-            self.ser.write(cmd.encode('utf-8'))
-            print(f"[DEBUG] Comando enviado: {cmd}")
+            cmd = format_channel_command(self.channel_params)
+            if self.engine.send_command(cmd):
+                print(f"[DEBUG] Comando enviado: {cmd}")
+            else:
+                self.status_label.setText(f"Reconectando: '{cmd}' se enviará al recuperar el puerto")
 
             self._set_channel_state_card(
             self.channel_params["channel"],
@@ -1047,4 +2114,6 @@ if __name__ == '__main__':
     window = RealTimePlot()
     window.resize(1200, 700)
     window.show()
+    t_window = time.perf_counter()
+    QtCore.QTimer.singleShot(0, lambda: _report_startup(t_window))
     sys.exit(app.exec())
\ No newline at end of file
@@ -0,0 +1,163 @@
+"""Análisis espectral EMG sin dependencias de Qt.
+
+- WelchPSD: PSD de Welch incremental con promedio exponencial entre segmentos.
+- spectral_frequencies: frecuencia media y mediana por canal (seguimiento de fatiga).
+- CrossSpectrum: matriz espectral cruzada de todos los pares -> coherencia y retardos.
+"""
+import numpy as np
+from numpy.lib.stride_tricks import sliding_window_view
+
+
+# Banda por defecto para las frecuencias media/mediana: excluye DC y artefactos de movimiento
+EMG_BAND_LO_HZ = 10.0
+
+
+class _SegmentStream:
+    """Segmentación de Welch sobre un flujo: cada segmento Hann se transforma una sola vez
+    al completarse y entra en un promedio exponencial (1-alpha)*prom + alpha*nuevo.
+
+    alpha = 1 da el último segmento; alpha = 1/K se comporta como la media de ~K segmentos.
+    """
+    def __init__(self, fs: float, nch: int, nperseg: int = 256, overlap: float = 0.5, alpha: float = 0.1):
+        self.fs = float(fs)
+        self.nch = int(nch)
+        self.nperseg = max(int(nperseg), 8)
+        self.overlap = min(max(float(overlap), 0.0), 0.95)
+        self.step = max(int(round(self.nperseg * (1.0 - self.overlap))), 1)
+        self.alpha = min(max(float(alpha), 1e-3), 1.0)
+        self.win = np.hanning(self.nperseg)
+        self._scale = 1.0 / (self.fs * np.sum(self.win ** 2))
+        self.f = np.fft.rfftfreq(self.nperseg, d=1.0 / self.fs)
+        self.reset()
+
+    def reset(self):
+        self._buf = np.zeros((0, self.nch))
+        self.segments = 0
+        self._avg = None
+
+    def _spectra(self, block: np.ndarray):
+        """rfft (n_seg, nch, nf) de los segmentos que 'block' completa; None si ninguno."""
+        buf = np.concatenate((self._buf, block)) if len(self._buf) else np.asarray(block, dtype=np.float64)
+        if len(buf) < self.nperseg:
+            self._buf = buf
+            return None
+        n_seg = (len(buf) - self.nperseg) // self.step + 1
+        # (n_seg, nch, nperseg) sin copiar: vistas sobre 'buf'
+        seg = sliding_window_view(buf, self.nperseg, axis=0)[::self.step][:n_seg]
+        seg = seg - seg.mean(axis=2, keepdims=True)
+        self._buf = buf[n_seg * self.step:].copy()
+        self.segments += n_seg
+        return np.fft.rfft(seg * self.win, axis=2)
+
+    def _average(self, P: np.ndarray):
+        """Mezcla los estimadores por segmento P (n_seg, ...) en el promedio exponencial."""
+        a = self.alpha
+        if self._avg is None:
+            self._avg, P = P[0], P[1:]
+        k = len(P)
+        if k:
+            weights = a * (1.0 - a) ** np.arange(k - 1, -1, -1)
+            self._avg = (1.0 - a) ** k * self._avg + np.tensordot(weights, P, axes=1)
+
+
+class WelchPSD(_SegmentStream):
+    """PSD de Welch por canal calculada a medida que llegan las muestras.
+
+    La escala es densidad espectral de una cara (V²/Hz), como scipy.signal.welch.
+    """
+    @property
+    def psd(self):
+        """(nch, nf), o None si aún no hay segmentos."""
+        return self._avg
+
+    def feed(self, block: np.ndarray) -> int:
+        """Añade muestras (n, nch); devuelve cuántos segmentos nuevos entraron al promedio."""
+        n0 = self.segments
+        X = self._spectra(block)
+        if X is None:
+            return 0
+        P = np.abs(X) ** 2 * self._scale
+        P[..., 1:(None if self.nperseg % 2 else -1)] *= 2.0
+        self._average(P)
+        return self.segments - n0
+
+    def frequencies(self, f_lo: float = EMG_BAND_LO_HZ, f_hi: float = None):
+        """(media, mediana) por canal de la PSD actual; None si aún no hay segmentos."""
+        if self.psd is None:
+            return None
+        return spectral_frequencies(self.f, self.psd, f_lo, f_hi)
+
+
+class CrossSpectrum(_SegmentStream):
+    """Matriz espectral cruzada S[f, i, j] = <X_i X_j*> de todos los pares de canales.
+
+    Cada segmento es una rfft en lote de los nch canales y un producto exterior por
+    frecuencia (einsum); coherencia y correlación cruzada salen de la matriz completa
+    con operaciones vectorizadas, sin bucles por par.
+    """
+    @property
+    def csd(self):
+        """(nf, nch, nch) complejo, o None si aún no hay segmentos."""
+        return self._avg
+
+    def feed(self, block: np.ndarray) -> int:
+        n0 = self.segments
+        X = self._spectra(block)
+        if X is None:
+            return 0
+        self._average(np.einsum('sif,sjf->sfij', X, X.conj()) * self._scale)
+        return self.segments - n0
+
+    def coherence(self, f_lo: float = EMG_BAND_LO_HZ, f_hi: float = None) -> np.ndarray:
+        """Coherencia cuadrática media en la banda, (nch, nch) en 0..1."""
+        band = self.f >= f_lo
+        if f_hi is not None:
+            band &= self.f <= f_hi
+        S = self.csd[band]
+        d = np.real(np.diagonal(S, axis1=1, axis2=2))
+        coh = np.abs(S) ** 2 / np.maximum(d[:, :, None] * d[:, None, :], 1e-300)
+        return coh.mean(axis=0)
+
+    def cross_correlation(self):
+        """(pico, retardo_s), ambos (nch, nch): correlación normalizada de mayor módulo y
+        su retardo. Retardo > 0 significa que el canal j va detrás del canal i."""
+        r = np.fft.fftshift(np.fft.irfft(self.csd, n=self.nperseg, axis=0), axes=0)
+        lags = (np.arange(self.nperseg) - self.nperseg // 2) / self.fs
+        r0 = np.real(np.diagonal(r[self.nperseg // 2], axis1=0, axis2=1))
+        norm = np.sqrt(np.maximum(np.outer(r0, r0), 1e-300))
+        idx = np.argmax(np.abs(r), axis=0)
+        peak = np.take_along_axis(r, idx[None], axis=0)[0] / norm
+        return peak, -lags[idx]
+
+
+def spectral_frequencies(f: np.ndarray, psd: np.ndarray, f_lo: float = 0.0, f_hi: float = None):
+    """Frecuencia media y mediana (Hz) de cada fila de 'psd' (nch, nf) dentro de [f_lo, f_hi].
+
+    La mediana se interpola dentro del bin que cruza la mitad de la potencia.
+    Los canales sin potencia en la banda devuelven NaN.
+    """
+    psd = np.atleast_2d(psd)
+    band = f >= f_lo
+    if f_hi is not None:
+        band &= f <= f_hi
+    fb, P = f[band], psd[:, band]
+    if len(fb) == 0:
+        nan = np.full(len(psd), np.nan)
+        return nan, nan.copy()
+    total = P.sum(axis=1)
+    ok = total > 0
+    safe = np.where(ok, total, 1.0)
+    mean_f = (P @ fb) / safe
+
+    cum = np.cumsum(P, axis=1)
+    half = 0.5 * total
+    idx = np.argmax(cum >= half[:, None], axis=1)
+    rows = np.arange(len(P))
+    before = np.where(idx > 0, cum[rows, np.maximum(idx - 1, 0)], 0.0)
+    frac = (half - before) / np.maximum(P[rows, idx], 1e-300)
+    df = fb[1] - fb[0] if len(fb) > 1 else 0.0
+    median_f = fb[idx] + (np.clip(frac, 0.0, 1.0) - 0.5) * df
+
+    mean_f[~ok] = np.nan
+    median_f[~ok] = np.nan
+    return mean_f, median_f
@@ -0,0 +1,1198 @@
+"""Motor de adquisición EMG sin Qt: puerto serie, decodificación de frames, buffers,
+grabación y métricas.
+
+La interfaz gráfica lo usa como un consumidor más; en equipos sin pantalla corre solo:
+
+    python motor_emg.py --port /dev/ttyACM0 --record sesion.emgz --config 00000 --stats 10
+"""
+import sys
+import os
+import time
+import threading
+import queue
+import argparse
+import signal
+import json
+import numpy as np
+import serial
+import serial.tools.list_ports
+
+from registro_emg import EMGRecorder, EMGZWriter, EXPORT_FORMATS, WIRE_COLUMN_OF_CHANNEL
+
+# Perfiles de adquisición: frecuencia de muestreo, ventana visible, tamaño de FFT
+# y refresco de FFT se cambian juntos en tiempo de ejecución.
+ACQ_PROFILES = {
+    "Estándar (600 Hz, 50 muestras)": {'sampling_rate': 600,  'points_to_show': 50,   'upsample_factor': 4, 'fft_size': 64,   'fft_refresh_ms': 200},
+    "Ventana 1 s (600 Hz)":           {'sampling_rate': 600,  'points_to_show': 600,  'upsample_factor': 1, 'fft_size': 1024, 'fft_refresh_ms': 250},
+    "EMG 1 kHz (0.5 s)":              {'sampling_rate': 1000, 'points_to_show': 500,  'upsample_factor': 1, 'fft_size': 512,  'fft_refresh_ms': 200},
+    "EMG 2 kHz (0.5 s)":              {'sampling_rate': 2000, 'points_to_show': 1000, 'upsample_factor': 1, 'fft_size': 1024, 'fft_refresh_ms': 250},
+}
+DEFAULT_ACQ_PROFILE = "Estándar (600 Hz, 50 muestras)"
+
+# Opciones de ChannelConfigDialog, en el orden de los índices que viajan en el comando
+SIGNAL_TYPES    = ["Nativa", "Rectificada", "Envolvente"]
+GAINS           = ["10", "25", "50"]
+LOWPASS_VALUES  = ["15 Hz", "20 Hz", "25 Hz"]
+HIGHPASS_VALUES = ["150 Hz", "350 Hz", "400 Hz"]
+
+FRAME_HDR = b'\xA5\x5A'          # datos u16 LE
+FRAME_HDR_PACKED = b'\xA5\x5B'   # datos de 12 bits empaquetados (2 muestras en 3 bytes)
+MAX_CHANNELS = 8
+
+# Petición al STM32 del formato de datos (mismo largo que los comandos de canal).
+# El decodificador acepta ambas cabeceras, así que un firmware que ignore el
+# comando sigue funcionando en u16.
+CMD_WIRE_PACKED12 = "W1000"
+CMD_WIRE_U16 = "W0000"
+
+# Baudrates ofrecidos; por encima de 115200 pensados para enlaces USB-CDC
+BAUD_RATES = [4800, 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600, 1000000, 2000000, 3000000]
+
+
+def pack12(values: np.ndarray) -> bytes:
+    """Empaqueta muestras de 12 bits de a pares: a0 a1 | a2 b0 | b1 b2 (nibbles, LSB primero)."""
+    v = np.asarray(values, dtype=np.uint16).ravel() & 0x0FFF
+    if len(v) % 2:
+        v = np.concatenate((v, [0]))
+    a, b = v[0::2], v[1::2]
+    out = np.empty((len(a), 3), dtype=np.uint8)
+    out[:, 0] = a & 0xFF
+    out[:, 1] = (a >> 8) | ((b & 0x0F) << 4)
+    out[:, 2] = b >> 4
+    return out.tobytes()
+
+
+def unpack12(payload, count: int) -> np.ndarray:
+    """Inverso vectorizado de pack12: 'count' muestras u16."""
+    b = np.frombuffer(payload, dtype=np.uint8, count=(count + 1) // 2 * 3).reshape(-1, 3).astype(np.uint16)
+    out = np.empty(len(b) * 2, dtype=np.uint16)
+    out[0::2] = b[:, 0] | ((b[:, 1] & 0x0F) << 8)
+    out[1::2] = (b[:, 1] >> 4) | (b[:, 2] << 4)
+    return out[:count]
+
+
+def payload_bytes(nch: int, nsamp: int, packed: bool) -> int:
+    n = nch * nsamp
+    return (n + 1) // 2 * 3 if packed else n * 2
+
+
+def wire_format_name(packed) -> str:
+    """Texto del formato de cable observado: True/False/None del decodificador."""
+    return "sin datos" if packed is None else ("12 bits" if packed else "16 bits")
+
+
+def max_rate_per_channel(baudrate: int, nch: int = MAX_CHANNELS, packed: bool = False) -> float:
+    """Frecuencia de muestreo máxima por canal que cabe en el enlace (8N1, sin contar cabeceras)."""
+    bytes_per_s = baudrate / 10.0
+    return bytes_per_s / (nch * (1.5 if packed else 2.0))
+
+
+def format_channel_command(params: dict) -> str:
+    """Comando de 5 caracteres para el STM32: canal, ganancia, LP, HP, tipo de señal."""
+    return (f"{params['channel']}{params['gain']}{params['lowpass']}"
+            f"{params['highpass']}{params['signal_type']}")
+
+
+def parse_channel_command(cmd: str) -> dict:
+    """Inverso de format_channel_command (ValueError si no es válido)."""
+    if len(cmd) != 5 or not cmd.isdigit():
+        raise ValueError(f"Comando de canal inválido: '{cmd}'")
+    ch, gain, lp, hp, tipo = (int(c) for c in cmd)
+    if ch >= MAX_CHANNELS:
+        raise ValueError(f"Canal fuera de rango en '{cmd}'")
+    return {"channel": ch, "gain": gain, "lowpass": lp, "highpass": hp, "signal_type": tipo}
+
+
+def describe_channel_config(signal_type_idx: int, gain_idx: int, lp_idx: int, hp_idx: int) -> dict:
+    """Índices de configuración -> estado legible (el de channel_states)."""
+    def pick(values, idx):
+        return values[idx] if 0 <= idx < len(values) else str(idx)
+    return {'configured': True,
+            'tipo': pick(SIGNAL_TYPES, signal_type_idx),
+            'gain': pick(GAINS, gain_idx),
+            'lp':   pick(LOWPASS_VALUES, lp_idx),
+            'hp':   pick(HIGHPASS_VALUES, hp_idx)}
+
+
+class ChannelCalibration:
+    """Cuentas ADC (orden de cable) -> voltios en el electrodo, por canal.
+
+    y = cuentas[:, cols] * mult + add, con mult = lsb * gain / amp_gain y add = -offset * mult:
+    - offset:   cuentas de la línea base (nominal: media escala en señal nativa, 0 si rectificada)
+    - gain:     corrección relativa medida con una referencia (1 = nominal)
+    - amp_gain: ganancia del amplificador configurada (10/25/50), que se compensa
+    'scale' y 'display_offset' son un factor y un desplazamiento globales de visualización.
+    mult y add se recalculan solo al cambiar la calibración; apply() es un único
+    producto-suma sobre el bloque (muestras x canales).
+    """
+    def __init__(self, v_ref: float, max_adc: int, nch: int = MAX_CHANNELS):
+        self.v_ref = float(v_ref)
+        self.max_adc = int(max_adc)
+        self.nch = int(nch)
+        self.cols = np.array(WIRE_COLUMN_OF_CHANNEL[:self.nch]) if self.nch == 8 else np.arange(self.nch)
+        self.reset()
+
+    def reset(self):
+        self.offset = np.zeros(self.nch)
+        self.gain = np.ones(self.nch)
+        self.amp_gain = np.ones(self.nch)
+        self.offset_captured = np.zeros(self.nch, dtype=bool)
+        self.scale = 1.0
+        self.display_offset = 0.0
+        self._update()
+
+    def _update(self):
+        m = self.v_ref / max(self.max_adc, 1) * self.gain / self.amp_gain * self.scale
+        self.mult = m.astype(np.float32)
+        self.add = (self.display_offset - self.offset * m).astype(np.float32)
+
+    def electrode_coeffs(self):
+        """(mult, add) por canal sin los factores de visualización: lo que se guarda en los registros."""
+        m = self.v_ref / max(self.max_adc, 1) * self.gain / self.amp_gain
+        return m.astype(np.float64), (-self.offset * m).astype(np.float64)
+
+    def set_display(self, scale: float, offset_volts: float):
+        self.scale = float(scale)
+        self.display_offset = float(offset_volts)
+        self._update()
+
+    def set_channel_config(self, ch: int, amp_gain: float, bipolar: bool = True):
+        """Ganancia del amplificador del canal y, si no hay cero medido, offset nominal."""
+        self.amp_gain[ch] = float(amp_gain) if float(amp_gain) > 0 else 1.0
+        if not self.offset_captured[ch]:
+            self.offset[ch] = (self.max_adc + 1) / 2.0 if bipolar else 0.0
+        self._update()
+
+    def apply(self, arr: np.ndarray) -> np.ndarray:
+        """Bloque (n, nch_frame) de cuentas -> (n, nch) float32 en voltios, orden de canal.
+
+        Los canales cuya columna no llega en el frame quedan a 0 V.
+        """
+        cols = self.cols
+        width = arr.shape[1]
+        if width <= int(cols.max()):
+            padded = np.zeros((len(arr), int(cols.max()) + 1), dtype=arr.dtype)
+            padded[:, :width] = arr
+            arr = padded
+        out = np.multiply(arr[:, cols], self.mult, dtype=np.float32)
+        out += self.add
+        if width <= int(cols.max()):
+            out[:, cols >= width] = 0.0
+        return out
+
+    def to_counts(self, ch: int, volts: float) -> float:
+        """Inverso de apply() para un canal (p. ej. un umbral en voltios -> cuentas)."""
+        return (float(volts) - float(self.add[ch])) / float(self.mult[ch])
+
+    # --- Captura de calibración (sobre cuentas crudas en orden de cable) ---
+    def capture_offset(self, raw: np.ndarray, channels=None):
+        """Entradas en corto / reposo: la media de cada canal pasa a ser su cero."""
+        means = raw[:, self.cols].astype(np.float64).mean(axis=0)
+        for ch in (range(self.nch) if channels is None else channels):
+            self.offset[ch] = means[ch]
+            self.offset_captured[ch] = True
+        self._update()
+        return means
+
+    def capture_gain(self, raw: np.ndarray, ref_rms_volts: float, channels=None):
+        """Referencia senoidal/cuadrada de RMS conocido en el electrodo: corrige 'gain'
+        para que el RMS medido (sin la media) coincida. Devuelve la corrección por canal."""
+        x = raw[:, self.cols].astype(np.float64)
+        rms_counts = np.sqrt(np.mean((x - x.mean(axis=0)) ** 2, axis=0))
+        lsb = self.v_ref / max(self.max_adc, 1)
+        measured = rms_counts * lsb / self.amp_gain
+        corr = np.where(measured > 0, float(ref_rms_volts) / np.maximum(measured, 1e-30), 1.0)
+        for ch in (range(self.nch) if channels is None else channels):
+            self.gain[ch] = corr[ch]
+        self._update()
+        return corr
+
+    def to_dict(self) -> dict:
+        return {'offset': self.offset.tolist(), 'gain': self.gain.tolist(),
+                'offset_captured': self.offset_captured.tolist()}
+
+    def load_dict(self, d: dict):
+        """Carga offset/gain/offset_captured; ValueError si no traen un valor por canal."""
+        arrays = {}
+        for key, dtype, default in (('offset', np.float64, None), ('gain', np.float64, None),
+                                    ('offset_captured', bool, [True] * self.nch)):
+            a = np.asarray(d[key] if default is None else d.get(key, default), dtype=dtype)
+            if a.shape != (self.nch,):
+                raise ValueError(f"'{key}' debe tener {self.nch} valores (tiene forma {a.shape})")
+            if dtype is np.float64 and not np.all(np.isfinite(a)):
+                raise ValueError(f"'{key}' contiene valores no finitos")
+            arrays[key] = a
+        if np.any(arrays['gain'] <= 0):
+            raise ValueError("'gain' debe ser positiva en todos los canales")
+        self.offset, self.gain, self.offset_captured = arrays['offset'], arrays['gain'], arrays['offset_captured']
+        self._update()
+
+    def save(self, path: str):
+        with open(path, 'w', encoding='utf-8') as f:
+            json.dump(self.to_dict(), f, indent=2)
+
+    def load(self, path: str):
+        with open(path, 'r', encoding='utf-8') as f:
+            self.load_dict(json.load(f))
+
+
+class FrameDecoder:
+    """Ensamblado de frames: A5 5A | nch u8 | nsamp u16 | seq u16 | datos u16 LE | chk u8.
+
+    Con cabecera A5 5B los datos van empaquetados a 12 bits (ver pack12). El checksum
+    es la suma de todos los bytes salvo el último, módulo 256.
+    """
+    def __init__(self):
+        self.buffer = bytearray()
+        self.packed_frames = 0
+        self.frames = 0
+        self.checksum_errors = 0
+        self.resync_bytes = 0
+        self.last_packed = None     # formato del último frame válido (None = aún ninguno)
+
+    def clear(self):
+        self.buffer.clear()
+        self.last_packed = None
+
+    def feed(self, data: bytes):
+        self.buffer.extend(data)
+
+    def decode(self, max_frames: int = None):
+        """Extrae los frames completos del buffer: lista de (seq, arr (nsamp, nch) u16)."""
+        out = []
+        buf = self.buffer
+        while max_frames is None or len(out) < max_frames:
+            # Mínimo: hdr(2) + nch(1) + nsamp(2) + seq(2) + chk(1) + al menos 2 bytes de datos
+            if len(buf) < 8:
+                break
+
+            # Buscar cabecera A5 5A / A5 5B (la primera que aparezca)
+            hdr_idx = buf.find(FRAME_HDR)
+            packed_idx = buf.find(FRAME_HDR_PACKED, 0, hdr_idx if hdr_idx != -1 else len(buf))
+            if packed_idx != -1:
+                hdr_idx = packed_idx
+            if hdr_idx == -1:
+                # no hay cabecera aún: descarta basura acumulada (salvo un posible A5 final)
+                keep = 1 if buf[-1] == FRAME_HDR[0] else 0
+                self.resync_bytes += len(buf) - keep
+                del buf[:len(buf) - keep]
+                break
+
+            # Descartar bytes previos a la cabecera
+            if hdr_idx > 0:
+                self.resync_bytes += hdr_idx
+                del buf[:hdr_idx]
+                if len(buf) < 8:
+                    break
+
+            packed = buf[1] == FRAME_HDR_PACKED[1]
+            nch   = buf[2]                                          # u8
+            nsamp = int.from_bytes(buf[3:5], 'little', signed=False)  # u16
+            seq   = int.from_bytes(buf[5:7], 'little', signed=False)  # u16
+
+            # Validación rápida de nch/nsamp para evitar reshape raros y bloques vacíos
+            if nch == 0 or nch > MAX_CHANNELS or nsamp == 0:
+                # valor imposible → resincroniza
+                del buf[0]
+                self.resync_bytes += 1
+                continue
+
+            total_len = 2 + 1 + 2 + 2 + payload_bytes(nch, nsamp, packed) + 1  # hdr + nch + nsamp + seq + data + chk
+
+            # Esperar a que llegue el frame completo
+            if len(buf) < total_len:
+                break
+
+            frame = bytes(buf[:total_len])
+
+            # Checksum (suma de todo salvo el último byte)
+            if int(np.frombuffer(frame, dtype=np.uint8, count=total_len - 1).sum()) & 0xFF != frame[-1]:
+                # byte corrupto → avanza 1 y reintenta
+                del buf[0]
+                self.checksum_errors += 1
+                self.resync_bytes += 1
+                continue
+
+            # Payload: quitar hdr(2), nch(1), nsamp(2), seq(2) y chk(1) → matriz (nsamp, nch)
+            if packed:
+                arr = unpack12(memoryview(frame)[7:-1], nch * nsamp).reshape(-1, nch)
+                self.packed_frames += 1
+            else:
+                arr = np.frombuffer(frame, dtype='<u2', count=nch * nsamp, offset=7).reshape(-1, nch)
+            del buf[:total_len]
+            self.frames += 1
+            self.last_packed = packed
+            out.append((seq, arr))
+        return out
+
+
+class SampleRing:
+    """Ring buffer (capacidad, nch) de cuentas ADC crudas, en orden de cable.
+
+    'total' cuenta las muestras escritas desde el último clear(); el lector pide las
+    últimas n con latest(). Protegido con lock: escribe el hilo del motor, leen otros.
+    """
+    def __init__(self, capacity: int, nch: int = MAX_CHANNELS):
+        self.nch = nch
+        self.data = np.zeros((max(int(capacity), 1), nch), dtype=np.uint16)
+        self.total = 0
+        self.lock = threading.Lock()
+
+    @property
+    def capacity(self):
+        return len(self.data)
+
+    def clear(self):
+        with self.lock:
+            self.total = 0
+
+    def resize(self, capacity: int):
+        with self.lock:
+            keep = min(self.total, self.capacity, capacity)
+            tail = self._latest_unlocked(keep)
+            self.data = np.zeros((max(int(capacity), 1), self.nch), dtype=np.uint16)
+            self.data[:keep] = tail
+            self.total = keep
+
+    def extend(self, block: np.ndarray):
+        n, m = len(block), min(block.shape[1], self.nch)
+        if n == 0:
+            return
+        with self.lock:
+            # Capacidad leída bajo el lock: resize() puede llegar desde otro hilo
+            cap = self.capacity
+            if n > cap:
+                self.total += n - cap
+                block, n = block[-cap:], cap
+            pos = self.total % cap
+            first = min(n, cap - pos)
+            self.data[pos:pos + first, :m] = block[:first, :m]
+            self.data[pos:pos + first, m:] = 0
+            if first < n:
+                self.data[:n - first, :m] = block[first:, :m]
+                self.data[:n - first, m:] = 0
+            self.total += n
+
+    def _latest_unlocked(self, n: int) -> np.ndarray:
+        n = min(int(n), self.total, self.capacity)
+        end = self.total % self.capacity
+        if n <= end:
+            return self.data[end - n:end].copy()
+        return np.concatenate((self.data[self.capacity - (n - end):], self.data[:end]))
+
+    def latest(self, n: int) -> np.ndarray:
+        """Copia de las últimas n muestras (n, nch) en orden temporal."""
+        with self.lock:
+            return self._latest_unlocked(n)
+
+    def since(self, total: int):
+        """(muestras escritas desde que 'total' tenía ese valor, total actual).
+
+        Si el lector se atrasó más que la capacidad recibe solo las últimas; si el anillo
+        se vació entretanto (total menor que el pedido) recibe todo lo que hay.
+        """
+        with self.lock:
+            if total > self.total:
+                total = 0
+            return self._latest_unlocked(self.total - total), self.total
+
+
+class EngineMetrics:
+    """Contadores del motor; snapshot() añade tasas desde el último snapshot."""
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        self.t_start = time.monotonic()
+        self.bytes_rx = 0
+        self.frames = 0
+        self.samples = 0
+        self.seq_gaps = 0
+        self.dropped_blocks = 0
+        self.checksum_errors = 0
+        self.resync_bytes = 0
+        self.packed_frames = 0
+        self.decode_s = 0.0         # tiempo dedicado a decodificar y repartir bloques
+        self.reconnects = 0
+        self.gap_samples = 0        # muestras por canal perdidas durante reconexiones
+        self.sink_errors = 0        # sinks retirados por lanzar excepciones
+        self.lost_samples = 0       # muestras por canal de frames perdidos (saltos de seq)
+        self.wire_packed = None     # formato recibido: True = 12 bits, False = 16, None = sin frames
+        self.clock = None           # ClockSync del motor (fs medida y deriva)
+        self._last = (self.t_start, 0, 0)
+
+    def snapshot(self) -> dict:
+        now = time.monotonic()
+        t0, b0, s0 = self._last
+        dt = max(now - t0, 1e-6)
+        self._last = (now, self.bytes_rx, self.samples)
+        return {
+            'uptime_s': now - self.t_start,
+            'bytes_rx': self.bytes_rx, 'frames': self.frames, 'samples': self.samples,
+            'seq_gaps': self.seq_gaps, 'dropped_blocks': self.dropped_blocks,
+            'checksum_errors': self.checksum_errors, 'resync_bytes': self.resync_bytes,
+            'packed_frames': self.packed_frames, 'wire_packed': self.wire_packed,
+            'reconnects': self.reconnects, 'gap_samples': self.gap_samples,
+            'sink_errors': self.sink_errors, 'lost_samples': self.lost_samples,
+            'decode_samples_per_s': self.samples / self.decode_s if self.decode_s > 0 else 0.0,
+            'bytes_per_s': (self.bytes_rx - b0) / dt, 'samples_per_s': (self.samples - s0) / dt,
+            'fs_measured': 1.0 / self.clock.period() if self.clock is not None else 0.0,
+            'drift_ppm': self.clock.drift_ppm if self.clock is not None else 0.0,
+        }
+
+    def format_line(self) -> str:
+        m = self.snapshot()
+        return (f"t={m['uptime_s']:.0f}s frames={m['frames']} muestras={m['samples']} "
+                f"({m['samples_per_s']:.0f}/s, {m['bytes_per_s'] / 1024:.1f} KiB/s) "
+                f"chk_err={m['checksum_errors']} resync={m['resync_bytes']} "
+                f"saltos_seq={m['seq_gaps']} descartados={m['dropped_blocks']} "
+                f"empaquetados={m['packed_frames']} formato={wire_format_name(m['wire_packed'])} reconexiones={m['reconnects']} "
+                f"sinks_fallidos={m['sink_errors']} "
+                f"fs_medida={m['fs_measured']:.3f}Hz deriva={m['drift_ppm']:+.1f}ppm")
+
+
+class ClockSync:
+    """Relación entre el reloj del dispositivo (índice de muestra) y el monotónico del host.
+
+    Cada bloque aporta un par (índice de su última muestra, hora de llegada). Se ajusta
+    t = a + periodo * índice por mínimos cuadrados con olvido exponencial (horizonte
+    'horizon_s'), actualizando medias y covarianza de forma incremental para que los
+    índices grandes no pierdan precisión. La latencia USB/planificador es ruido sobre la
+    hora de llegada: la regresión promedia su parte aleatoria (la media queda como un
+    desfase constante) y deja la deriva real del oscilador.
+    Mientras el ajuste abarca menos de MIN_SPAN_S se usa el periodo nominal (o el último
+    estimado, tras una reconexión).
+    Protegido con lock: actualiza el hilo del motor; set_nominal() llega desde la GUI.
+    """
+    MIN_SPAN_S = 5.0
+
+    def __init__(self, fs_nominal: float, horizon_s: float = 300.0):
+        self.horizon_s = float(horizon_s)
+        self.lock = threading.RLock()
+        self.set_nominal(fs_nominal)
+
+    def set_nominal(self, fs_nominal: float):
+        with self.lock:
+            self.fs_nominal = float(fs_nominal)
+            self.reset(period=None)
+
+    def reset(self, period: float = None):
+        """Reinicia el ajuste; 'period' sirve de valor provisional hasta tener datos."""
+        with self.lock:
+            self._reset_unlocked(period)
+
+    def _reset_unlocked(self, period):
+        self._seed = float(period) if period else 1.0 / self.fs_nominal
+        self._origin = None         # (índice, t) del primer par: se trabaja relativo a él
+        self._w = 0.0
+        self._mx = self._my = 0.0
+        self._cxx = self._cxy = 0.0
+        self._x_first = self._x_last = 0.0
+        self.points = 0
+
+    def update(self, sample_idx: int, t_host: float):
+        with self.lock:
+            self._update_unlocked(sample_idx, t_host)
+
+    def _update_unlocked(self, sample_idx: int, t_host: float):
+        if self._origin is None:
+            self._origin = (int(sample_idx), float(t_host))
+        x = float(sample_idx - self._origin[0])
+        y = float(t_host - self._origin[1])
+        if self.points:
+            decay = np.exp(-(x - self._x_last) / (self.horizon_s * self.fs_nominal))
+            self._w *= decay
+            self._cxx *= decay
+            self._cxy *= decay
+        else:
+            self._x_first = x
+        self._x_last = x
+        self.points += 1
+        self._w += 1.0
+        dx = x - self._mx
+        self._mx += dx / self._w
+        self._my += (y - self._my) / self._w
+        self._cxx += dx * (x - self._mx)
+        self._cxy += dx * (y - self._my)
+
+    @property
+    def locked(self) -> bool:
+        """True si el periodo sale del ajuste (y no del nominal/provisional)."""
+        with self.lock:
+            return (self._x_last - self._x_first) * self._seed >= self.MIN_SPAN_S and self._cxx > 0
+
+    def period(self) -> float:
+        """Segundos del host por muestra del dispositivo."""
+        with self.lock:
+            return self._cxy / self._cxx if self.locked else self._seed
+
+    @property
+    def drift_ppm(self) -> float:
+        """Desvío del reloj del dispositivo respecto a su nominal (+ = muestrea más rápido)."""
+        return (1.0 / (self.period() * self.fs_nominal) - 1.0) * 1e6
+
+    def time_of(self, sample_idx: int) -> float:
+        """Hora monotónica del host estimada para la muestra 'sample_idx'."""
+        with self.lock:
+            if self._origin is None:
+                return time.monotonic()
+            x = float(sample_idx - self._origin[0])
+            return self._origin[1] + self._my + self.period() * (x - self._mx)
+
+
+def process_rss_mb() -> float:
+    """Memoria residente actual (MB); 0 si no se puede leer."""
+    try:
+        with open('/proc/self/status') as f:
+            for line in f:
+                if line.startswith('VmRSS:'):
+                    return int(line.split()[1]) / 1024.0
+    except OSError:
+        pass
+    try:
+        import resource
+        return resource.getrusage(resource.RUSAGE_SELF).ru_maxrss / 1024.0
+    except (ImportError, OSError):
+        return 0.0
+
+
+def _port_identity(info):
+    """(VID, PID, nº de serie) de un puerto USB; None si no es USB."""
+    if getattr(info, 'vid', None) is None:
+        return None
+    return (info.vid, info.pid, info.serial_number)
+
+
+class PortMonitor:
+    """Sondea los puertos serie en un hilo propio (comports() puede tardar segundos).
+
+    'ports' es una lista [(device, descripción)] que se reemplaza entera en cada cambio;
+    'version' se incrementa con cada cambio para que la GUI detecte conexiones en caliente.
+    """
+    def __init__(self, interval_s: float = 1.0):
+        self.interval_s = interval_s
+        self.ports = []
+        self.version = 0
+        self.error = None
+        self.scanned = threading.Event()
+        self._wake = threading.Event()
+        self._stop = threading.Event()
+        self._thread = threading.Thread(target=self._run, name="PortMonitor", daemon=True)
+        self._thread.start()
+
+    def refresh(self):
+        """Pide un sondeo inmediato (sin esperar el resultado)."""
+        self._wake.set()
+
+    def stop(self):
+        self._stop.set()
+        self._wake.set()
+        self._thread.join(timeout=2.0)
+
+    def _run(self):
+        while not self._stop.is_set():
+            # Se limpia antes de sondear: un refresh() que llegue durante el sondeo no se pierde
+            self._wake.clear()
+            try:
+                ports = [(p.device, p.description or 'N/A') for p in serial.tools.list_ports.comports()]
+                self.error = None
+            except Exception as e:
+                ports, self.error = self.ports, e
+            if ports != self.ports:
+                self.ports = ports
+                self.version += 1
+            self.scanned.set()
+            self._wake.wait(self.interval_s)
+
+
+class TriggeredCapture:
+    """Disparo tipo osciloscopio y promedio de ensayos; se registra como sink del motor.
+
+    Se arma sobre el cruce de 'threshold' (cuentas ADC) en la columna 'column' del frame,
+    o sobre marcas externas (mark()). Cada ventana [t-pre, t+post) se lee directamente del
+    anillo del motor (vista sin copia salvo que dé la vuelta) y se suma al acumulador de
+    todos los canales en una sola operación. 'holdoff' muestras tras un disparo no se
+    rearma; con single=True se desarma tras el primer disparo.
+    """
+    def __init__(self, ring: SampleRing, column: int, threshold: float, pre: int, post: int,
+                 rising: bool = True, holdoff: int = None, single: bool = False, use_threshold: bool = True):
+        self.ring = ring
+        self.column = int(column)
+        self.threshold = float(threshold)
+        self.pre = max(int(pre), 0)
+        self.post = max(int(post), 1)
+        if self.pre + self.post > ring.capacity:
+            raise ValueError(f"La ventana ({self.pre + self.post} muestras) no cabe en el anillo ({ring.capacity})")
+        self.rising = bool(rising)
+        self.holdoff = self.post if holdoff is None else max(int(holdoff), 0)
+        self.single = bool(single)
+        self.use_threshold = bool(use_threshold)
+        self.lock = threading.Lock()
+        self.armed = True
+        self.reset()
+
+    def reset(self):
+        """Vacía el promedio y los disparos pendientes (sigue armado si lo estaba)."""
+        with self.lock:
+            self._sum = np.zeros((self.pre + self.post, self.ring.nch))
+            self._last_trial = np.zeros((self.pre + self.post, self.ring.nch))
+            self.trials = 0
+            self.missed = 0
+            self._pending = []
+            self._prev = None
+            self._end = 0
+            self._next_allowed = 0
+
+    def arm(self):
+        with self.lock:
+            self.armed = True
+
+    def mark(self):
+        """Marca externa/manual en la muestra actual."""
+        with self.lock:
+            if self.armed:
+                self._trigger(self.ring.total)
+
+    def push(self, block: np.ndarray, ts=None):
+        """Llamado por el motor tras escribir 'block' en el anillo."""
+        if len(block) == 0:
+            return
+        with self.lock:
+            end = self.ring.total
+            start = end - len(block)
+            if start < self._end:
+                # El anillo se vació o redimensionó: los índices anteriores ya no valen
+                self._pending, self._prev, self._next_allowed = [], None, 0
+            self._end = end
+            if self.use_threshold and self.armed and self.column < block.shape[1]:
+                x = block[:, self.column].astype(np.float64)
+                prev = np.empty_like(x)
+                prev[0] = x[0] if self._prev is None else self._prev
+                prev[1:] = x[:-1]
+                if self.rising:
+                    hits = np.flatnonzero((prev < self.threshold) & (x >= self.threshold))
+                else:
+                    hits = np.flatnonzero((prev > self.threshold) & (x <= self.threshold))
+                for i in hits:
+                    if not self.armed:
+                        break
+                    self._trigger(start + int(i))
+            if len(block) and self.column < block.shape[1]:
+                self._prev = float(block[-1, self.column])
+            self._complete(end)
+
+    def mark_gap(self, n: int):
+        # Una ventana que cruce el hueco mezclaría señal de antes y después
+        with self.lock:
+            self._pending, self._prev = [], None
+
+    def _trigger(self, t: int):
+        if t < self._next_allowed:
+            return
+        self._pending.append(t)
+        self._next_allowed = t + self.holdoff
+        if self.single:
+            self.armed = False
+
+    def _complete(self, end: int):
+        ready = [t for t in self._pending if t + self.post <= end]
+        if not ready:
+            return
+        self._pending = [t for t in self._pending if t + self.post > end]
+        with self.ring.lock:
+            cap, total = self.ring.capacity, self.ring.total
+            for t in ready:
+                a, b = t - self.pre, t + self.post
+                if a < 0 or a < total - cap:
+                    self.missed += 1      # el pretrigger ya no está en el anillo
+                    continue
+                i0, i1 = a % cap, b % cap
+                if i0 < i1 or i1 == 0:
+                    win = self.ring.data[i0:i0 + (b - a)]      # vista, sin copia
+                else:
+                    win = np.concatenate((self.ring.data[i0:], self.ring.data[:i1]))
+                self._sum += win
+                self._last_trial[:] = win
+                self.trials += 1
+
+    def snapshot(self):
+        """(promedio, último ensayo, nº de ensayos): arrays (pre+post, nch) en cuentas ADC."""
+        with self.lock:
+            n = self.trials
+            mean = self._sum / n if n else np.zeros_like(self._sum)
+            return mean, self._last_trial.copy(), n
+
+
+class AcquisitionEngine:
+    """Lee el puerto en un hilo propio, decodifica frames y reparte los bloques.
+
+    - ring:        últimas muestras crudas (SampleRing) para quien las pida.
+    - sinks:       EMGRecorder (grabación/exportación) reciben cada bloque.
+    - subscribe(): cola por consumidor (p. ej. la GUI) con (seq, bloque, ts).
+    Los errores del puerto quedan en 'error' (take_error()) en lugar de lanzarse.
+
+    'ts' = (t0, periodo): hora epoch de la primera muestra del bloque y periodo medido,
+    del ajuste de 'clock' (ClockSync) entre seq del dispositivo y llegada al host.
+
+    Si el puerto falla, el hilo lector intenta reabrirlo durante 'reconnect_timeout' s
+    (también si el SO lo renumera), reenvía la configuración de canales y marca el
+    hueco en los sinks; take_gaps() devuelve los huecos ocurridos. Solo si no lo consigue
+    queda el error.
+    """
+    RING_SECONDS = 10
+    RECONNECT_TIMEOUT_S = 30.0
+
+    def __init__(self, profile: str = DEFAULT_ACQ_PROFILE):
+        self.decoder = FrameDecoder()
+        self.metrics = EngineMetrics()
+        self.ser = None
+        self.error = None
+        self._thread = None
+        self._stop = threading.Event()
+        self._write_lock = threading.Lock()
+        self._sinks = []
+        self._subscribers = []
+        self._last_seq = None
+        self._last_rx = None
+        self._serial_params = None
+        self._port_id = None
+        self._replay = {}           # último comando por canal ('W' = formato de cable)
+        self._gaps = []
+        self.reconnect_timeout = self.RECONNECT_TIMEOUT_S   # 0 = sin reconexión automática
+        self.reconnecting = False
+        self.packed_requested = False
+        self.profile = None
+        self.fs = ACQ_PROFILES[DEFAULT_ACQ_PROFILE]['sampling_rate']
+        self.ring = SampleRing(self.fs * self.RING_SECONDS)
+        self.clock = ClockSync(self.fs)
+        self.metrics.clock = self.clock
+        self._device_idx = 0        # muestras del dispositivo desde open(), contando frames perdidos
+        self._wall_offset = time.time() - time.monotonic()
+        self.set_profile(profile)
+
+    @property
+    def is_open(self) -> bool:
+        return self.ser is not None and self.ser.is_open
+
+    @property
+    def wire_packed(self):
+        """Formato que llega de verdad (cabecera A5 5B/5A del último frame); None sin frames.
+
+        El cambio de formato no tiene confirmación: esto, y no 'packed_requested', es lo
+        que hay que mostrar.
+        """
+        return self.decoder.last_packed
+
+    @property
+    def port(self):
+        """Puerto actual (puede cambiar tras una reconexión)."""
+        return self._serial_params.get('port') if self._serial_params else None
+
+    def set_profile(self, name: str):
+        prof = ACQ_PROFILES.get(name)
+        if prof is None:
+            raise ValueError(f"Perfil de adquisición desconocido: '{name}'")
+        self.profile = name
+        self.fs = prof['sampling_rate']
+        self.clock.set_nominal(self.fs)
+        if self.ring.capacity != self.fs * self.RING_SECONDS:
+            self.ring.resize(self.fs * self.RING_SECONDS)
+
+    def open(self, serial_params: dict):
+        """Abre el puerto y arranca el hilo lector. Propaga las excepciones de pyserial.
+
+        'serial_params' son los argumentos de serial.Serial más, opcionalmente,
+        'packed12': True para pedir al STM32 el formato empaquetado de 12 bits.
+        """
+        self.close()
+        params = dict(serial_params)
+        packed12 = bool(params.pop('packed12', False))
+        self.packed_requested = packed12
+        self.ser = self._open_serial(params)
+        self._serial_params = params
+        self._port_id = None
+        self._replay = {}
+        self._gaps = []
+        self.error = None
+        self.decoder.clear()
+        self.ring.clear()
+        self.metrics.reset()
+        self.metrics.clock = self.clock
+        self.clock.reset()
+        self._device_idx = 0
+        self._wall_offset = time.time() - time.monotonic()
+        self._last_seq = None
+        self._last_rx = None
+        self._stop.clear()
+        self._thread = threading.Thread(target=self._run, name="AcquisitionEngine", daemon=True)
+        self._thread.start()
+        if packed12:
+            self.send_command(CMD_WIRE_PACKED12)
+
+    @staticmethod
+    def _open_serial(params: dict):
+        ser = serial.Serial(**params)
+        ser.reset_input_buffer()
+        ser.reset_output_buffer()
+        return ser
+
+    def close(self):
+        self._stop.set()
+        if self._thread is not None and self._thread is not threading.current_thread():
+            self._thread.join(timeout=2.0)
+        self._thread = None
+        if self.ser is not None:
+            try:
+                self.ser.close()
+            except Exception as e:
+                print(f"[ERROR] [AcquisitionEngine] Error al cerrar el puerto: {e}")
+        self.ser = None
+        self.reconnecting = False
+
+    def take_error(self):
+        err, self.error = self.error, None
+        return err
+
+    def take_gaps(self) -> list:
+        """Huecos por reconexión desde la última llamada: [(segundos, muestras por canal)]."""
+        gaps, self._gaps = self._gaps, []
+        return gaps
+
+    def send_command(self, cmd: str) -> bool:
+        """Escribe un comando al STM32 (desde cualquier hilo).
+
+        Durante una reconexión no se lanza: el comando queda como configuración deseada,
+        se reenvía al recuperar el puerto y se devuelve False. True = escrito ya.
+        """
+        with self._write_lock:
+            ser = self.ser
+            if ser is None or not ser.is_open:
+                if not self.reconnecting:
+                    raise serial.SerialException("Puerto no abierto")
+                self._remember_command(cmd)
+                return False
+            ser.write(cmd.encode('utf-8'))
+            self._remember_command(cmd)
+        return True
+
+    def _remember_command(self, cmd: str):
+        """Último comando por canal (y formato de cable), para reenviarlo al reconectar."""
+        if cmd in (CMD_WIRE_PACKED12, CMD_WIRE_U16):
+            self._replay['W'] = cmd
+        else:
+            try:
+                self._replay[parse_channel_command(cmd)['channel']] = cmd
+            except ValueError:
+                pass
+
+    def add_sink(self, sink: EMGRecorder):
+        self._sinks = self._sinks + [sink]
+
+    def remove_sink(self, sink: EMGRecorder):
+        self._sinks = [s for s in self._sinks if s is not sink]
+
+    def subscribe(self, maxsize: int = 512) -> queue.Queue:
+        q = queue.Queue(maxsize=maxsize)
+        self._subscribers = self._subscribers + [q]
+        return q
+
+    def unsubscribe(self, q: queue.Queue):
+        self._subscribers = [s for s in self._subscribers if s is not q]
+
+    def _run(self):
+        self._port_id = self._identify_port(self._serial_params['port'])
+        while not self._stop.is_set():
+            ser = self.ser
+            try:
+                # Bloquea hasta 'timeout' esperando datos: sin espera activa
+                data = ser.read(max(ser.in_waiting, 1))
+            except (serial.SerialException, OSError, TypeError, AttributeError) as e:
+                if self._stop.is_set():
+                    break
+                err = e if isinstance(e, serial.SerialException) else serial.SerialException(str(e))
+                if self.reconnect_timeout > 0 and self._reconnect(err):
+                    continue
+                if not self._stop.is_set():
+                    self.error = err
+                break
+            if not data:
+                if not ser.timeout:
+                    self._stop.wait(0.005)  # timeout=0 → evita girar en vacío
+                continue
+            t_rx = time.monotonic()
+            self.metrics.bytes_rx += len(data)
+            t0 = time.perf_counter()
+            self.decoder.feed(data)
+            try:
+                for seq, arr in self.decoder.decode():
+                    self._dispatch(seq, arr, t_rx)
+            except Exception as e:
+                # Fallo interno (no del puerto): se reporta como error en vez de morir en silencio
+                print(f"[ERROR] [AcquisitionEngine] Error al decodificar/repartir: {e!r}")
+                self.error = e
+                break
+            self.metrics.decode_s += time.perf_counter() - t0
+            self.metrics.checksum_errors = self.decoder.checksum_errors
+            self.metrics.resync_bytes = self.decoder.resync_bytes
+            self.metrics.packed_frames = self.decoder.packed_frames
+            self.metrics.wire_packed = self.decoder.last_packed
+
+    @staticmethod
+    def _identify_port(device: str):
+        try:
+            for p in serial.tools.list_ports.comports():
+                if p.device == device:
+                    return _port_identity(p)
+        except Exception:
+            pass
+        return None
+
+    def _find_port(self):
+        """Puerto a reabrir: el mismo si sigue listado; si no, el del mismo VID/PID/serie."""
+        device = self._serial_params['port']
+        if self._port_id is None:
+            return device           # no es USB (o no se pudo identificar): se reintenta tal cual
+        try:
+            ports = serial.tools.list_ports.comports()
+        except Exception:
+            return device
+        for p in ports:
+            if p.device == device:
+                return device
+        for p in ports:
+            if _port_identity(p) == self._port_id:
+                return p.device
+        return None
+
+    def _reconnect(self, err) -> bool:
+        """Reabre el puerto (desde el hilo lector). True si lo consigue antes del plazo."""
+        print(f"[WARN] [AcquisitionEngine] Conexión perdida ({err}); reintentando durante "
+              f"{self.reconnect_timeout:g} s...")
+        self.reconnecting = True
+        t_lost = time.monotonic()
+        with self._write_lock:
+            old, self.ser = self.ser, None
+        try:
+            old.close()
+        except Exception:
+            pass
+
+        ser, delay = None, 0.1
+        deadline = t_lost + self.reconnect_timeout
+        while ser is None and not self._stop.is_set() and time.monotonic() < deadline:
+            device = self._find_port()
+            if device is not None:
+                try:
+                    ser = self._open_serial(dict(self._serial_params, port=device))
+                except (serial.SerialException, OSError, ValueError):
+                    ser = None
+            if ser is None:
+                self._stop.wait(min(delay, max(deadline - time.monotonic(), 0.0)))
+                delay = min(delay * 2, 2.0)
+        if ser is None:
+            self.reconnecting = False
+            return False
+        if self._stop.is_set():
+            ser.close()
+            self.reconnecting = False
+            return False
+
+        self._serial_params['port'] = device
+        with self._write_lock:
+            self.ser = ser
+            # Incluye lo pedido con send_command() durante el corte
+            replay = ([self._replay['W']] if 'W' in self._replay else []) + \
+                     [self._replay[ch] for ch in sorted(k for k in self._replay if k != 'W')]
+        self.decoder.clear()
+        self._last_seq = None
+        try:
+            for cmd in replay:
+                self.send_command(cmd)
+        except (serial.SerialException, OSError) as e:
+            print(f"[ERROR] [AcquisitionEngine] No se pudo reenviar la configuración: {e}")
+
+        # Hueco: lo que el dispositivo habría enviado mientras no había enlace
+        gap_s = time.monotonic() - t_lost
+        n = int(round(gap_s * self.fs))
+        self._to_sinks('mark_gap', n)
+        # La numeración del dispositivo se pierde: se continúa con el hueco estimado y el
+        # ajuste se reinicia partiendo del periodo ya medido
+        self._device_idx += n
+        self.clock.reset(period=self.clock.period())
+        self.metrics.reconnects += 1
+        self.metrics.gap_samples += n
+        self._gaps.append((gap_s, n))
+        self.reconnecting = False
+        print(f"[INFO] [AcquisitionEngine] Reconectado a {device} tras {gap_s:.2f} s "
+              f"({len(replay)} comandos reenviados).")
+        return True
+
+    def _to_sinks(self, method: str, *args):
+        """Llama 'method' en cada sink; el que falla se retira sin detener la adquisición."""
+        for sink in self._sinks:
+            try:
+                getattr(sink, method)(*args)
+            except Exception as e:
+                print(f"[ERROR] [AcquisitionEngine] {type(sink).__name__}.{method} falló ({e!r}); se retira el sink.")
+                self.remove_sink(sink)
+                self.metrics.sink_errors += 1
+
+    def _dispatch(self, seq: int, arr: np.ndarray, t_rx: float = None):
+        m = self.metrics
+        if self._last_seq is not None and seq != (self._last_seq + 1) & 0xFFFF:
+            m.seq_gaps += 1
+            # Frames perdidos (salto hacia delante): avanzan el reloj del dispositivo y se
+            # marcan como hueco en los sinks, para que el índice de los ficheros siga al del
+            # dispositivo (si no, la sincronía leería la pérdida como deriva del reloj).
+            # Un salto mayor que lo que cabe en el tiempo transcurrido (+1 s de margen por
+            # lecturas en ráfaga) es un seq corrupto y no se cuenta.
+            lost = (((seq - self._last_seq) & 0xFFFF) - 1) * len(arr)
+            elapsed = t_rx - self._last_rx if t_rx is not None and self._last_rx is not None else 0.0
+            if lost < 0x7FFF * len(arr) and lost <= 1.5 * (elapsed + 1.0) * self.fs:
+                self._device_idx += lost
+                m.lost_samples += lost
+                self._to_sinks('mark_gap', lost)
+        self._last_seq = seq
+        self._last_rx = t_rx
+        m.frames += 1
+        m.samples += len(arr)
+
+        first = self._device_idx
+        self._device_idx += len(arr)
+        if t_rx is not None:
+            self.clock.update(self._device_idx - 1, t_rx)
+        ts = (self.clock.time_of(first) + self._wall_offset, self.clock.period())
+
+        self.ring.extend(arr)
+        self._to_sinks('push', arr, ts)
+        item = (seq, arr, ts)
+        for q in self._subscribers:
+            try:
+                q.put_nowait(item)
+            except queue.Full:
+                # Consumidor atrasado: se descarta el bloque más viejo
+                try:
+                    q.get_nowait()
+                except queue.Empty:
+                    pass
+                m.dropped_blocks += 1
+                q.put_nowait(item)
+
+
+# --- Modo daemon (sin pantalla) ---
+def _export_writer_for(path: str, fs, v_ref, max_adc, channel_meta):
+    ext = os.path.splitext(path)[1].lower()
+    for fmt_ext, factory in EXPORT_FORMATS.values():
+        if fmt_ext == ext:
+            return factory(path, MAX_CHANNELS, fs, v_ref, max_adc, channel_meta)
+    raise ValueError(f"Extensión de exportación no soportada: '{ext}' (use .edf, .bdf o .h5)")
+
+
+def main(argv=None) -> int:
+    parser = argparse.ArgumentParser(description="Adquisición EMG sin interfaz gráfica.")
+    parser.add_argument('--port', help="Puerto serie (por defecto el primero disponible)")
+    parser.add_argument('--baud', type=int, default=115200, help=f"Baudrate (p. ej. {', '.join(map(str, BAUD_RATES[-6:]))})")
+    parser.add_argument('--packed', action='store_true', help="Pedir datos empaquetados de 12 bits")
+    parser.add_argument('--timeout', type=float, default=0.05, help="Timeout de lectura (s)")
+    parser.add_argument('--profile', default=DEFAULT_ACQ_PROFILE, choices=list(ACQ_PROFILES.keys()))
+    parser.add_argument('--config', action='append', default=[], metavar='CGLHT',
+                        help="Comando de canal a enviar al conectar (repetible)")
+    parser.add_argument('--record', help="Grabar en formato comprimido .emgz")
+    parser.add_argument('--export', help="Exportar en streaming (.edf, .bdf o .h5)")
+    parser.add_argument('-v', '--verbose', action='store_true', help="Mostrar los comandos enviados")
+    parser.add_argument('--stats', type=float, default=10.0, help="Intervalo de métricas (s); 0 = sin métricas")
+    parser.add_argument('--reconnect', type=float, default=AcquisitionEngine.RECONNECT_TIMEOUT_S,
+                        help="Plazo de reconexión automática (s); 0 = terminar al perder el puerto")
+    parser.add_argument('--duration', type=float, default=0.0, help="Detener tras N segundos (0 = sin límite)")
+    parser.add_argument('--list-ports', action='store_true')
+    args = parser.parse_args(argv)
+
+    if args.list_ports:
+        for p in serial.tools.list_ports.comports():
+            print(f"{p.device}\t{p.description or 'N/A'}")
+        return 0
+
+    port = args.port
+    if not port:
+        ports = serial.tools.list_ports.comports()
+        if not ports:
+            print("[ERROR] No hay puertos seriales disponibles.", file=sys.stderr)
+            return 2
+        port = ports[0].device
+
+    try:
+        commands = [parse_channel_command(c) for c in args.config]
+    except ValueError as e:
+        print(f"[ERROR] {e}", file=sys.stderr)
+        return 2
+    channel_meta = [{'configured': False} for _ in range(MAX_CHANNELS)]
+    for c in commands:
+        channel_meta[c['channel']] = describe_channel_config(c['signal_type'], c['gain'], c['lowpass'], c['highpass'])
+
+    v_ref, max_adc = 3.3, 4095
+    engine = AcquisitionEngine(args.profile)
+    engine.reconnect_timeout = args.reconnect
+    serial_params = {'port': port, 'baudrate': args.baud, 'bytesize': serial.EIGHTBITS,
+                     'stopbits': serial.STOPBITS_ONE, 'parity': serial.PARITY_NONE, 'timeout': args.timeout,
+                     'packed12': args.packed}
+    sinks = []
+    try:
+        if args.record:
+            sinks.append(EMGRecorder(EMGZWriter(args.record, MAX_CHANNELS, engine.fs, v_ref, max_adc)))
+        if args.export:
+            sinks.append(EMGRecorder(_export_writer_for(args.export, engine.fs, v_ref, max_adc, channel_meta)))
+        engine.open(serial_params)
+        for s in sinks:
+            engine.add_sink(s)
+        for c in commands:
+            engine.send_command(format_channel_command(c))
+            if args.verbose:
+                print(f"[DEBUG] Comando enviado: {format_channel_command(c)}")
+    except (serial.SerialException, OSError, ValueError, RuntimeError) as e:
+        print(f"[ERROR] No se pudo iniciar la adquisición: {e}", file=sys.stderr)
+        engine.close()
+        for s in sinks:
+            engine.remove_sink(s)
+            s.stop()
+        return 1
+
+    stop = threading.Event()
+    for sig in (signal.SIGINT, signal.SIGTERM):
+        signal.signal(sig, lambda *_: stop.set())
+
+    fs_max = max_rate_per_channel(args.baud, MAX_CHANNELS, args.packed)
+    if engine.fs > fs_max:
+        print(f"[WARN] {args.baud} baudios admiten ~{fs_max:.0f} Hz por canal con 8 canales; "
+              f"el perfil pide {engine.fs} Hz.", file=sys.stderr)
+    print(f"[INFO] Adquiriendo de {port} ({args.baud}) con perfil '{args.profile}'. Ctrl+C para terminar.")
+    t_end = time.monotonic() + args.duration if args.duration > 0 else None
+    status = 0
+    while not stop.is_set():
+        wait = args.stats if args.stats > 0 else 1.0
+        if t_end is not None:
+            wait = min(wait, max(t_end - time.monotonic(), 0.0))
+        stop.wait(wait)
+        err = engine.take_error()
+        if err is not None:
+            print(f"[ERROR] Se perdió la conexión: {err}", file=sys.stderr)
+            status = 1
+            break
+        for gap_s, n in engine.take_gaps():
+            print(f"[WARN] Hueco de {gap_s:.2f} s ({n} muestras) marcado en el registro.", file=sys.stderr)
+        if args.stats > 0:
+            print(f"[STATS] {engine.metrics.format_line()}", flush=True)
+        if t_end is not None and time.monotonic() >= t_end:
+            break
+
+    engine.close()
+    for s in sinks:
+        engine.remove_sink(s)
+        s.stop()
+        if s.error is not None:
+            print(f"[ERROR] Error al escribir: {s.error}", file=sys.stderr)
+            status = 1
+    return status
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,772 @@
+"""Formatos de registro de sesiones EMG, sin dependencias de Qt.
+
+- .emgz: cuentas ADC sin pérdida, comprimidas por chunks con índice para acceso aleatorio.
+- Exportación en streaming a EDF+/BDF+ y HDF5, y conversión por lotes desde .emgz.
+- Pirámide min/max (EMGOverview) para revisar sesiones largas.
+- Puntos de sincronía (muestra, hora medida por el motor) guardados en todos los formatos.
+"""
+import struct
+import threading
+import queue
+import mmap
+import bisect
+import time
+import datetime
+import numpy as np
+
+
+# --- Registro comprimido de sesión (.emgz) ---
+# Cabecera | chunk* | índice | pie. Cada chunk guarda hasta EMGZ_CHUNK_SAMPLES muestras
+# por canal como residuos de predicción lineal (diferencias de orden 0..2) en zigzag,
+# empaquetados a ancho fijo por bloques de EMGZ_BLOCK. El índice final da acceso aleatorio.
+EMGZ_MAGIC = b'EMGZ'
+EMGZ_VERSION = 1
+EMGZ_HDR = struct.Struct('<4sBBHffd')       # magic, versión, nch, max_adc, fs, v_ref, t0 (epoch)
+EMGZ_CHUNK_HDR = struct.Struct('<2sQII')    # b'CK', primera muestra, nsamp, bytes de payload
+EMGZ_INDEX_ENTRY = struct.Struct('<QQI')    # primera muestra, offset del chunk, nsamp
+EMGZ_FOOTER = struct.Struct('<QI4s')        # offset del índice, nº de entradas, b'EMGI'
+EMGZ_SECTION_HDR = struct.Struct('<2sI')    # b'GP' huecos / b'TS' sincronía, nº de entradas (tras el último chunk, opcionales)
+EMGZ_GAP_ENTRY = struct.Struct('<QQ')       # primera muestra del hueco, nº de muestras
+EMGZ_SYNC_ENTRY = struct.Struct('<Qd')      # muestra, hora epoch medida (ClockSync del motor)
+EMGZ_CAL_ENTRY = struct.Struct('<dd')       # b'CL' por canal (orden de canal): V = cuentas * mult + add
+EMGZ_CHUNK_SAMPLES = 4096
+EMGZ_BLOCK = 256
+
+# Columna del frame (orden de cable) que corresponde a cada canal 0..7
+WIRE_COLUMN_OF_CHANNEL = (0, 1, 2, 3, 6, 5, 4, 7)
+
+
+def _emgz_pack(u: np.ndarray) -> bytes:
+    """Empaqueta enteros sin signo por bloques: 1 byte de ancho + bits (LSB primero)."""
+    out = bytearray()
+    for i in range(0, len(u), EMGZ_BLOCK):
+        blk = u[i:i + EMGZ_BLOCK]
+        width = int(blk.max()).bit_length()
+        out.append(width)
+        if width:
+            bits = ((blk[:, None] >> np.arange(width, dtype=np.uint64)) & np.uint64(1)).astype(np.uint8)
+            out += np.packbits(bits.ravel(), bitorder='little').tobytes()
+    return bytes(out)
+
+
+def _emgz_unpack(buf, pos: int, n: int):
+    out = np.zeros(n, dtype=np.uint64)
+    for i in range(0, n, EMGZ_BLOCK):
+        m = min(EMGZ_BLOCK, n - i)
+        width = buf[pos]; pos += 1
+        if width == 0:
+            continue
+        nbytes = (m * width + 7) // 8
+        raw = np.frombuffer(buf, dtype=np.uint8, count=nbytes, offset=pos)
+        bits = np.unpackbits(raw, count=m * width, bitorder='little').reshape(m, width)
+        out[i:i + m] = (bits.astype(np.uint64) << np.arange(width, dtype=np.uint64)).sum(axis=1)
+        pos += nbytes
+    return out, pos
+
+
+def _emgz_encode_chunk(block: np.ndarray) -> bytes:
+    """(nsamp, nch) u16 -> payload. Elige por canal el orden de predicción con menor residuo."""
+    parts = []
+    x_all = block.astype(np.int64)
+    for c in range(x_all.shape[1]):
+        x = x_all[:, c]
+        best_order, best_cost = 0, None
+        for order in (0, 1, 2):
+            if len(x) <= order:
+                break
+            cost = np.abs(np.diff(x, n=order)).mean() if order else np.abs(x).mean()
+            if best_cost is None or cost < best_cost:
+                best_order, best_cost = order, cost
+        heads = [int(np.diff(x, n=k)[0]) for k in range(best_order)]
+        r = np.diff(x, n=best_order) if best_order else x
+        zz = ((r << 1) ^ (r >> 63)).astype(np.uint64)
+        parts.append(struct.pack('<B', best_order))
+        parts.append(struct.pack(f'<{best_order}i', *heads))
+        parts.append(_emgz_pack(zz))
+    return b''.join(parts)
+
+
+def _emgz_decode_chunk(buf, pos: int, nsamp: int, nch: int) -> np.ndarray:
+    out = np.empty((nsamp, nch), dtype=np.uint16)
+    for c in range(nch):
+        order = buf[pos]; pos += 1
+        heads = struct.unpack_from(f'<{order}i', buf, pos); pos += 4 * order
+        zz, pos = _emgz_unpack(buf, pos, nsamp - order)
+        zz = zz.astype(np.int64)
+        x = (zz >> 1) ^ -(zz & 1)
+        # Integra de vuelta cada nivel de diferencias partiendo de su primer valor
+        for k in reversed(range(order)):
+            x = np.concatenate(([heads[k]], heads[k] + np.cumsum(x)))
+        out[:, c] = x
+    return out
+
+
+def check_calibration(calibration, nch: int):
+    """(mult, add) por canal -> par de arrays float64 (nch,) validados; None si no hay."""
+    if calibration is None:
+        return None
+    mult, add = (np.asarray(v, dtype=np.float64).reshape(-1) for v in calibration)
+    if mult.shape != (nch,) or add.shape != (nch,):
+        raise ValueError(f"La calibración debe tener {nch} coeficientes por término")
+    if not (np.isfinite(mult).all() and np.isfinite(add).all()) or (mult == 0).any():
+        raise ValueError("Calibración con coeficientes no válidos")
+    return mult, add
+
+
+def sync_times(sync, idx, fs: float):
+    """Hora epoch de las muestras 'idx' según los puntos de sincronía [(muestra, epoch)].
+
+    Interpola entre puntos y extrapola con la pendiente del tramo extremo; con un solo
+    punto se usa la fs nominal. Devuelve None si no hay puntos.
+    """
+    if not sync:
+        return None
+    s = np.asarray(sync, dtype=np.float64)
+    idx = np.asarray(idx, dtype=np.float64)
+    if len(s) == 1:
+        return s[0, 1] + (idx - s[0, 0]) / fs
+    t = np.interp(idx, s[:, 0], s[:, 1])
+    lo, hi = idx < s[0, 0], idx > s[-1, 0]
+    t = np.where(lo, s[0, 1] + (idx - s[0, 0]) * (s[1, 1] - s[0, 1]) / (s[1, 0] - s[0, 0]), t)
+    return np.where(hi, s[-1, 1] + (idx - s[-1, 0]) * (s[-1, 1] - s[-2, 1]) / (s[-1, 0] - s[-2, 0]), t)
+
+
+def measured_rate(sync):
+    """fs real (muestras/s) entre el primer y el último punto de sincronía; None si no hay tramo."""
+    if len(sync) < 2 or sync[-1][1] <= sync[0][1]:
+        return None
+    return (sync[-1][0] - sync[0][0]) / (sync[-1][1] - sync[0][1])
+
+
+class _RecordBlockWriter:
+    """Base de los escritores: acumula bloques y entrega registros de tamaño fijo a _write_record."""
+    def __init__(self, nch, record_samples):
+        self.nch = int(nch)
+        self.record_samples = max(int(record_samples), 1)
+        self._pending = []
+        self._pending_n = 0
+        self._last_row = None
+        self.samples_written = 0
+        self.gaps = []          # (primera muestra, nº de muestras) rellenadas sin señal
+        self.sync = []          # (muestra, hora epoch) aprox. una vez por registro
+        self.start_time = None  # epoch de la muestra 0 si se conoce de antemano (conversión)
+        self.calibration = None # (mult, add) por canal: V en el electrodo (ver check_calibration)
+
+    def write(self, block: np.ndarray, ts=None):
+        """'ts' = (epoch de la primera muestra, periodo) del motor, si se conoce."""
+        if not len(block):
+            return
+        first = self.samples_written + self._pending_n
+        if ts is not None and (not self.sync or first - self.sync[-1][0] >= self.record_samples):
+            self.sync.append((first, float(ts[0])))
+        self._last_row = block[-1:]
+        self._pending.append(block)
+        self._pending_n += len(block)
+        if self._pending_n >= self.record_samples:
+            data = np.concatenate(self._pending)
+            cut = len(data) - len(data) % self.record_samples
+            for i in range(0, cut, self.record_samples):
+                self._write_record(data[i:i + self.record_samples])
+                self.samples_written += self.record_samples
+            self._pending = [data[cut:]] if cut < len(data) else []
+            self._pending_n = len(data) - cut
+
+    def mark_gap(self, n: int):
+        """Hueco de n muestras sin señal (una reconexión o frames perdidos).
+
+        Se rellena repitiendo la última muestra para que la base de tiempos siga siendo
+        continua, y se anota en 'gaps' para que cada formato lo marque.
+        """
+        n = max(int(n), 0)
+        self.gaps.append((self.samples_written + self._pending_n, n))
+        last = self._last_row if self._last_row is not None else np.zeros((1, self.nch), dtype=np.uint16)
+        while n > 0:
+            k = min(n, self.record_samples)
+            self.write(np.repeat(last, k, axis=0))
+            n -= k
+
+    def _flush_pending(self):
+        """Devuelve (y vacía) la cola parcial que no completó un registro."""
+        rest = np.concatenate(self._pending) if self._pending_n else None
+        self._pending, self._pending_n = [], 0
+        return rest
+
+    def _write_record(self, block: np.ndarray):
+        raise NotImplementedError
+
+
+class EMGZWriter(_RecordBlockWriter):
+    """Escritor de .emgz por chunks; close() añade el índice y el pie."""
+    def __init__(self, path, nch, fs, v_ref, max_adc, chunk_samples=EMGZ_CHUNK_SAMPLES, calibration=None):
+        super().__init__(nch, chunk_samples)
+        self.calibration = check_calibration(calibration, self.nch)
+        self.path = path
+        self._f = open(path, 'wb')
+        self._f.write(EMGZ_HDR.pack(EMGZ_MAGIC, EMGZ_VERSION, self.nch, int(max_adc),
+                                    float(fs), float(v_ref), time.time()))
+        self._index = []
+        self.bytes_written = EMGZ_HDR.size
+
+    def _write_record(self, chunk: np.ndarray):
+        payload = _emgz_encode_chunk(chunk)
+        offset = self._f.tell()
+        self._f.write(EMGZ_CHUNK_HDR.pack(b'CK', self.samples_written, len(chunk), len(payload)))
+        self._f.write(payload)
+        self._index.append((self.samples_written, offset, len(chunk)))
+        self.bytes_written += EMGZ_CHUNK_HDR.size + len(payload)
+
+    def close(self):
+        if self._f is None:
+            return
+        rest = self._flush_pending()
+        if rest is not None:
+            self._write_record(rest)
+            self.samples_written += len(rest)
+        if self.gaps:
+            self._f.write(EMGZ_SECTION_HDR.pack(b'GP', len(self.gaps)))
+            for entry in self.gaps:
+                self._f.write(EMGZ_GAP_ENTRY.pack(*entry))
+        if self.sync:
+            self._f.write(EMGZ_SECTION_HDR.pack(b'TS', len(self.sync)))
+            for entry in self.sync:
+                self._f.write(EMGZ_SYNC_ENTRY.pack(*entry))
+        if self.calibration is not None:
+            self._f.write(EMGZ_SECTION_HDR.pack(b'CL', self.nch))
+            for entry in zip(*self.calibration):
+                self._f.write(EMGZ_CAL_ENTRY.pack(*entry))
+        index_offset = self._f.tell()
+        for entry in self._index:
+            self._f.write(EMGZ_INDEX_ENTRY.pack(*entry))
+        self._f.write(EMGZ_FOOTER.pack(index_offset, len(self._index), b'EMGI'))
+        self._f.close()
+        self._f = None
+
+
+class EMGRecorder:
+    """Graba en segundo plano: update_plot solo encola bloques crudos y el hilo escribe.
+
+    'writer' es cualquier escritor con write()/close() (EMGZWriter, EDFWriter, HDF5Writer).
+    """
+    def __init__(self, writer):
+        self.nch = writer.nch
+        self.error = None
+        self._writer = writer
+        self._q = queue.Queue()
+        self._thread = threading.Thread(target=self._run, name="EMGRecorder", daemon=True)
+        self._thread.start()
+
+    @property
+    def samples_written(self):
+        return self._writer.samples_written
+
+    def push(self, block: np.ndarray, ts=None):
+        """Encola un bloque (nsamp, nch_frame) de cuentas ADC; rellena con 0 los canales ausentes."""
+        if block.shape[1] != self.nch:
+            padded = np.zeros((len(block), self.nch), dtype=np.uint16)
+            m = min(block.shape[1], self.nch)
+            padded[:, :m] = block[:, :m]
+            block = padded
+        self._q.put((block, ts))
+
+    def mark_gap(self, n: int):
+        """Encola un hueco de n muestras (ver _RecordBlockWriter.mark_gap)."""
+        self._q.put(int(n))
+
+    def _run(self):
+        while True:
+            blk = self._q.get()
+            if blk is None:
+                break
+            if self.error is not None:
+                continue
+            try:
+                if isinstance(blk, int):
+                    self._writer.mark_gap(blk)
+                else:
+                    self._writer.write(*blk)
+            except Exception as e:
+                self.error = e
+                print(f"[ERROR] [EMGRecorder] Error al escribir registro: {e}")
+
+    def stop(self):
+        self._q.put(None)
+        self._thread.join()
+        try:
+            self._writer.close()
+        except Exception as e:
+            self.error = self.error or e
+
+
+class EMGZReader:
+    """Lectura con acceso aleatorio de un .emgz (mmap + índice; reconstruye el índice si falta el pie)."""
+    def __init__(self, path):
+        self.path = path
+        self._f = open(path, 'rb')
+        self._mm = mmap.mmap(self._f.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, version, nch, max_adc, fs, v_ref, t0 = EMGZ_HDR.unpack_from(self._mm, 0)
+        if magic != EMGZ_MAGIC or version > EMGZ_VERSION:
+            self.close()
+            raise ValueError(f"{path} no es un registro EMGZ válido")
+        self.nch, self.max_adc, self.fs, self.v_ref, self.t0 = nch, max_adc, fs, v_ref, t0
+        self._index = self._load_index()
+        self._starts = [e[0] for e in self._index]
+        self.n_samples = (self._index[-1][0] + self._index[-1][2]) if self._index else 0
+        self.gaps, self.sync, cal = self._load_sections()
+        # Calibración grabada (V en el electrodo); None en registros sin ella (V del ADC)
+        self.calibration = None
+        if len(cal) == self.nch:
+            try:
+                self.calibration = check_calibration(tuple(zip(*cal)), self.nch)
+            except ValueError:
+                pass
+        self._cache = {}
+
+    def _load_index(self):
+        mm = self._mm
+        if len(mm) >= EMGZ_HDR.size + EMGZ_FOOTER.size:
+            index_offset, count, tag = EMGZ_FOOTER.unpack_from(mm, len(mm) - EMGZ_FOOTER.size)
+            if tag == b'EMGI':
+                return [EMGZ_INDEX_ENTRY.unpack_from(mm, index_offset + i * EMGZ_INDEX_ENTRY.size)
+                        for i in range(count)]
+        # Sin pie (grabación interrumpida): recorre los chunks completos
+        index, pos = [], EMGZ_HDR.size
+        while pos + EMGZ_CHUNK_HDR.size <= len(mm):
+            tag, first, nsamp, nbytes = EMGZ_CHUNK_HDR.unpack_from(mm, pos)
+            if tag != b'CK' or pos + EMGZ_CHUNK_HDR.size + nbytes > len(mm):
+                break
+            index.append((first, pos, nsamp))
+            pos += EMGZ_CHUNK_HDR.size + nbytes
+        return index
+
+    def _load_sections(self):
+        """Tablas de huecos, sincronía y calibración tras el último chunk (todas opcionales)."""
+        tables = {b'GP': [], b'TS': [], b'CL': []}
+        if not self._index:
+            return tables[b'GP'], tables[b'TS'], tables[b'CL']
+        entries = {b'GP': EMGZ_GAP_ENTRY, b'TS': EMGZ_SYNC_ENTRY, b'CL': EMGZ_CAL_ENTRY}
+        _, offset, _ = self._index[-1]
+        pos = offset + EMGZ_CHUNK_HDR.size + EMGZ_CHUNK_HDR.unpack_from(self._mm, offset)[3]
+        while pos + EMGZ_SECTION_HDR.size <= len(self._mm):
+            tag, count = EMGZ_SECTION_HDR.unpack_from(self._mm, pos)
+            entry = entries.get(tag)
+            pos += EMGZ_SECTION_HDR.size
+            if entry is None or pos + count * entry.size > len(self._mm):
+                break
+            tables[tag] = [entry.unpack_from(self._mm, pos + i * entry.size) for i in range(count)]
+            pos += count * entry.size
+        return tables[b'GP'], tables[b'TS'], tables[b'CL']
+
+    @property
+    def fs_measured(self) -> float:
+        """fs real según la sincronía grabada (la nominal si el registro no la tiene)."""
+        return measured_rate(self.sync) or self.fs
+
+    def sample_times(self, start: int, stop: int) -> np.ndarray:
+        """Hora epoch de las muestras [start, stop): medida si hay sincronía, nominal si no."""
+        idx = np.arange(max(int(start), 0), min(int(stop), self.n_samples))
+        t = sync_times(self.sync, idx, self.fs)
+        return t if t is not None else self.t0 + idx / self.fs
+
+    @property
+    def n_chunks(self):
+        return len(self._index)
+
+    def chunk_info(self, i: int):
+        """(primera muestra, offset, nsamp) del chunk i."""
+        return self._index[i]
+
+    def decode_chunk(self, i: int) -> np.ndarray:
+        """Decodifica el chunk i sin pasar por la caché (para recorridos completos)."""
+        first, offset, nsamp = self._index[i]
+        return _emgz_decode_chunk(self._mm, offset + EMGZ_CHUNK_HDR.size, nsamp, self.nch)
+
+    def _chunk(self, i: int) -> np.ndarray:
+        data = self._cache.get(i)
+        if data is None:
+            data = self.decode_chunk(i)
+            if len(self._cache) >= 16:
+                self._cache.pop(next(iter(self._cache)))
+            self._cache[i] = data
+        return data
+
+    def read(self, start: int, stop: int) -> np.ndarray:
+        """Cuentas ADC (n, nch) de las muestras [start, stop)."""
+        start = max(0, int(start)); stop = min(self.n_samples, int(stop))
+        if stop <= start:
+            return np.empty((0, self.nch), dtype=np.uint16)
+        i = bisect.bisect_right(self._starts, start) - 1
+        parts = []
+        while i < len(self._index) and self._index[i][0] < stop:
+            first, _, nsamp = self._index[i]
+            a = max(start - first, 0); b = min(stop - first, nsamp)
+            parts.append(self._chunk(i)[a:b])
+            i += 1
+        return np.concatenate(parts)
+
+    def volts(self, counts: np.ndarray, ch: int) -> np.ndarray:
+        """Cuentas (n, nch) -> V del canal 'ch': calibrados si el registro lleva calibración."""
+        col = WIRE_COLUMN_OF_CHANNEL[ch] if self.nch == 8 else ch
+        x = counts[:, col].astype(np.float64)
+        if self.calibration is None:
+            return x * (self.v_ref / max(self.max_adc, 1))
+        return x * self.calibration[0][ch] + self.calibration[1][ch]
+
+    def read_seconds(self, t_start: float, t_stop: float) -> np.ndarray:
+        return self.read(int(round(t_start * self.fs)), int(round(t_stop * self.fs)))
+
+    def close(self):
+        self._cache = {}
+        if getattr(self, '_mm', None) is not None:
+            self._mm.close(); self._mm = None
+        if getattr(self, '_f', None) is not None:
+            self._f.close(); self._f = None
+
+
+# --- Exportación a formatos estándar (EDF+/BDF+, HDF5) ---
+def _edf_field(value, width: int) -> bytes:
+    text = value if isinstance(value, str) else f"{value:g}"
+    return text.encode('ascii', 'replace')[:width].ljust(width)
+
+
+def _edf_number(value: float, width: int = 8) -> str:
+    """Número con tantos decimales como quepan en el campo."""
+    for decimals in range(6, -1, -1):
+        text = f"{value:.{decimals}f}"
+        if len(text) <= width:
+            return text
+    return f"{value:.0f}"[:width]
+
+
+def _edf_physical(lo: float, hi: float):
+    """(dimensión, mín., máx.) en V, mV o uV: la unidad que deja más cifras en 8 caracteres."""
+    peak = max(abs(lo), abs(hi))
+    for unit, k in (("V", 1.0), ("mV", 1e3), ("uV", 1e6)):
+        if peak * k >= 1.0:
+            break
+    return unit, _edf_number(lo * k), _edf_number(hi * k)
+
+
+def channel_meta_text(meta: dict) -> str:
+    """Texto de prefiltrado/config de un canal a partir de channel_states."""
+    if not meta or not meta.get('configured'):
+        return "Canal no configurado"
+    return f"HP:{meta.get('hp')} LP:{meta.get('lp')} G:{meta.get('gain')} {meta.get('tipo')}"
+
+
+class EDFWriter(_RecordBlockWriter):
+    """EDF+C (16 bits) o BDF+C (24 bits) en streaming: un data record por segundo.
+
+    Se guardan las cuentas ADC centradas (dig = adc - max_adc//2) y la cabecera
+    mapea el rango digital a 0..v_ref V, así que la conversión es exacta. Con
+    'calibration' el rango físico de cada canal es el de la calibración (V en el
+    electrodo): mín. = add, máx. = max_adc * mult + add.
+    """
+    ANNOT_BYTES = 120
+    GAP_LABEL = "Hueco (sin datos)"
+
+    def __init__(self, path, nch, fs, v_ref, max_adc, channel_meta=None, bdf=False, record_seconds=1,
+                 calibration=None):
+        super().__init__(nch, int(round(fs)) * int(record_seconds))
+        self.calibration = check_calibration(calibration, self.nch)
+        self.path = path
+        self.bdf = bool(bdf)
+        self.record_seconds = int(record_seconds)
+        self._fs = float(fs)
+        self._t_base = None         # segundo entero de inicio (EDF+: onsets relativos a él)
+        self._bps = 3 if self.bdf else 2
+        self._annot_samples = self.ANNOT_BYTES // self._bps
+        self._offset = int(max_adc) // 2
+        self._n_records = 0
+        self._gap_next = 0          # primer hueco de 'gaps' aún no pasado a anotación
+        self._annot_queue = []      # anotaciones que no cupieron: van en los registros siguientes
+        self.annotations_dropped = 0
+        self._cols = list(WIRE_COLUMN_OF_CHANNEL) if self.nch == 8 else list(range(self.nch))
+        meta = list(channel_meta or [])
+
+        ns = self.nch + 1
+        dig_lim = 1 << (8 * self._bps - 1)
+        start = datetime.datetime.now()
+        hdr = [
+            b'\xffBIOSEMI' if self.bdf else _edf_field('0', 8),
+            _edf_field('X X X X', 80),
+            _edf_field(f"Startdate {start.strftime('%d-%b-%Y').upper()} X X SISTEMA_EMG", 80),
+            _edf_field(start.strftime('%d.%m.%y'), 8),
+            _edf_field(start.strftime('%H.%M.%S'), 8),
+            _edf_field(str(256 * (ns + 1)), 8),
+            _edf_field('BDF+C' if self.bdf else 'EDF+C', 44),
+            _edf_field('-1', 8),
+            _edf_field(str(self.record_seconds), 8),
+            _edf_field(str(ns), 4),
+        ]
+        annot = 'BDF Annotations' if self.bdf else 'EDF Annotations'
+        if self.calibration is None:
+            phys = [("V", 0.0, float(v_ref))] * self.nch
+        else:
+            mult, add = self.calibration
+            phys = [_edf_physical(add[ch], int(max_adc) * mult[ch] + add[ch]) for ch in range(self.nch)]
+        fields = (
+            ([f"Canal {ch}" for ch in range(self.nch)] + [annot], 16),
+            (["Electrodo bipolar"] * self.nch + [""], 80),
+            ([p[0] for p in phys] + [""], 8),
+            ([p[1] for p in phys] + [-1.0], 8),
+            ([p[2] for p in phys] + [1.0], 8),
+            ([str(-self._offset)] * self.nch + [str(-dig_lim)], 8),
+            ([str(int(max_adc) - self._offset)] * self.nch + [str(dig_lim - 1)], 8),
+            ([channel_meta_text(meta[ch] if ch < len(meta) else None) for ch in range(self.nch)] + [""], 80),
+            ([str(self.record_samples)] * self.nch + [str(self._annot_samples)], 8),
+            ([""] * ns, 32),
+        )
+        for values, width in fields:
+            hdr.extend(_edf_field(v, width) for v in values)
+
+        self._f = open(path, 'wb')
+        self._f.write(b''.join(hdr))
+
+    def _encode(self, values: np.ndarray) -> bytes:
+        if self.bdf:
+            return values.astype('<i4').view(np.uint8).reshape(-1, 4)[:, :3].tobytes()
+        return values.astype('<i2').tobytes()
+
+    def _epoch_of(self, sample: int):
+        """Hora epoch de 'sample': por la sincronía si la hay; si no, start_time + nominal."""
+        if self.sync:
+            return float(sync_times(self.sync, sample, self._fs))
+        if self.start_time is not None:
+            return float(self.start_time) + sample / self._fs
+        return None
+
+    def _onset(self, sample: int) -> float:
+        """Segundos desde el inicio del fichero: medidos si hay sincronía, nominales si no."""
+        if self._t_base is None:
+            t0 = self._epoch_of(0)
+            if t0 is not None:
+                self._t_base = float(np.floor(t0))
+        if self._t_base is None:
+            return sample / self._fs
+        return self._epoch_of(sample) - self._t_base
+
+    def _write_record(self, block: np.ndarray):
+        dig = block[:, self._cols].astype(np.int32) - self._offset
+        parts = [self._encode(dig[:, ch]) for ch in range(self.nch)]
+        first = self.samples_written
+        if self.sync or self.start_time is not None or self._t_base is not None:
+            tal = f"+{self._onset(first):.4f}\x14\x14\x00".encode('ascii')
+        else:
+            tal = f"+{self._n_records * self.record_seconds}\x14\x14\x00".encode('ascii')
+        # Huecos que empiezan en este registro, como anotaciones con duración. Las que no
+        # caben se guardan para los registros siguientes (el onset es absoluto en EDF+).
+        while self._gap_next < len(self.gaps) and self.gaps[self._gap_next][0] < first + len(block):
+            start, n = self.gaps[self._gap_next]
+            self._gap_next += 1
+            self._annot_queue.append(
+                f"+{self._onset(start):.3f}\x15{n / self._fs:.3f}\x14{self.GAP_LABEL}\x14\x00".encode('ascii'))
+        size = self._annot_samples * self._bps
+        while self._annot_queue and len(tal) + len(self._annot_queue[0]) <= size:
+            tal += self._annot_queue.pop(0)
+        parts.append(tal.ljust(size, b'\x00'))
+        self._f.write(b''.join(parts))
+        self._n_records += 1
+
+    def close(self):
+        if self._f is None:
+            return
+        rest = self._flush_pending()
+        if rest is not None:
+            # EDF exige registros completos: se rellena repitiendo la última muestra
+            pad = np.repeat(rest[-1:], self.record_samples - len(rest), axis=0)
+            self._write_record(np.concatenate((rest, pad)))
+            self.samples_written += len(rest)
+        if self._annot_queue:
+            self.annotations_dropped = len(self._annot_queue)
+            print(f"[WARN] [EDFWriter] {self.annotations_dropped} anotaciones de hueco no cupieron "
+                  f"en los últimos registros de {self.path}")
+        self._f.seek(236)
+        self._f.write(_edf_field(str(self._n_records), 8))
+        fs = measured_rate(self.sync)
+        if fs:
+            # Duración real del registro según el reloj del host (resolución ~1 ppm)
+            self._f.write(_edf_field(f"{self.record_samples / fs:.6f}", 8))
+        if self._t_base is not None:
+            start = datetime.datetime.fromtimestamp(self._t_base)
+            self._f.seek(88)
+            self._f.write(_edf_field(f"Startdate {start.strftime('%d-%b-%Y').upper()} X X SISTEMA_EMG", 80))
+            self._f.write(_edf_field(start.strftime('%d.%m.%y'), 8))
+            self._f.write(_edf_field(start.strftime('%H.%M.%S'), 8))
+        self._f.close()
+        self._f = None
+
+
+class HDF5Writer(_RecordBlockWriter):
+    """HDF5 en streaming: dataset /emg/adc (n, nch) u16 ampliado por bloques, metadatos como atributos."""
+    def __init__(self, path, nch, fs, v_ref, max_adc, channel_meta=None, record_samples=None, calibration=None):
+        try:
+            import h5py
+        except ImportError:
+            raise RuntimeError("La exportación HDF5 requiere el paquete 'h5py'.")
+        super().__init__(nch, record_samples or int(round(fs)))
+        self.calibration = check_calibration(calibration, self.nch)
+        self.path = path
+        self._cols = list(WIRE_COLUMN_OF_CHANNEL) if self.nch == 8 else list(range(self.nch))
+        self._f = h5py.File(path, 'w')
+        grp = self._f.create_group('emg')
+        self._ds = grp.create_dataset('adc', shape=(0, self.nch), maxshape=(None, self.nch), dtype='<u2',
+                                      chunks=(self.record_samples, self.nch),
+                                      compression='gzip', compression_opts=1)
+        meta = list(channel_meta or [])
+        grp.attrs['sampling_rate'] = float(fs)
+        grp.attrs['v_ref'] = float(v_ref)
+        grp.attrs['max_adc'] = int(max_adc)
+        grp.attrs['volts_per_count'] = float(v_ref) / max(int(max_adc), 1)
+        grp.attrs['start_time'] = time.time()
+        self._ds.attrs['labels'] = [f"Canal {ch}" for ch in range(self.nch)]
+        for key in ('configured', 'tipo', 'gain', 'lp', 'hp'):
+            self._ds.attrs[key] = [str((meta[ch] if ch < len(meta) else {}).get(key) or '')
+                                   for ch in range(self.nch)]
+        # V en el electrodo = adc * calibration_mult + calibration_add (por columna)
+        grp.attrs['calibrated'] = self.calibration is not None
+        if self.calibration is not None:
+            self._ds.attrs['calibration_mult'] = self.calibration[0]
+            self._ds.attrs['calibration_add'] = self.calibration[1]
+
+    def _write_record(self, block: np.ndarray):
+        n0 = self._ds.shape[0]
+        self._ds.resize(n0 + len(block), axis=0)
+        self._ds[n0:] = block[:, self._cols]
+
+    def close(self):
+        if self._f is None:
+            return
+        rest = self._flush_pending()
+        if rest is not None:
+            self._write_record(rest)
+            self.samples_written += len(rest)
+        self._ds.attrs['gaps'] = np.array(self.gaps, dtype='<u8').reshape(-1, 2)
+        grp = self._f['emg']
+        if self.start_time is not None:
+            grp.attrs['start_time'] = float(self.start_time)
+        if self.sync:
+            grp.create_dataset('sync', data=np.array(self.sync, dtype='<f8'))
+            grp.attrs['start_time'] = float(sync_times(self.sync, 0, grp.attrs['sampling_rate']))
+            grp.attrs['sampling_rate_measured'] = measured_rate(self.sync) or grp.attrs['sampling_rate']
+        self._f.close()
+        self._f = None
+
+
+# Filtro del diálogo -> (extensión, fábrica(path, nch, fs, v_ref, max_adc, channel_meta, calibration=None))
+EXPORT_FORMATS = {
+    "EDF+ (*.edf)": ('.edf', lambda path, nch, fs, v_ref, max_adc, meta, cal=None:
+                     EDFWriter(path, nch, fs, v_ref, max_adc, meta, calibration=cal)),
+    "BDF+ (*.bdf)": ('.bdf', lambda path, nch, fs, v_ref, max_adc, meta, cal=None:
+                     EDFWriter(path, nch, fs, v_ref, max_adc, meta, bdf=True, calibration=cal)),
+    "HDF5 (*.h5)":  ('.h5',  lambda path, nch, fs, v_ref, max_adc, meta, cal=None:
+                     HDF5Writer(path, nch, fs, v_ref, max_adc, meta, calibration=cal)),
+}
+
+
+def convert_recording(src: str, dst: str, fmt: str, channel_meta=None, progress=None):
+    """Convierte un .emgz a 'fmt' (clave de EXPORT_FORMATS) chunk a chunk.
+
+    La calibración grabada en el .emgz, si la hay, pasa a la cabecera de la exportación.
+    """
+    reader = EMGZReader(src)
+    try:
+        writer = EXPORT_FORMATS[fmt][1](dst, reader.nch, reader.fs, reader.v_ref, reader.max_adc, channel_meta,
+                                        reader.calibration)
+        writer.gaps = list(reader.gaps)
+        writer.sync = list(reader.sync)
+        writer.start_time = reader.t0     # la sincronía, si la hay, lo refina
+        try:
+            for i in range(reader.n_chunks):
+                writer.write(reader.decode_chunk(i))
+                if progress is not None and not progress(i + 1, reader.n_chunks):
+                    break
+        finally:
+            writer.close()
+    finally:
+        reader.close()
+
+
+class EMGOverview:
+    """Pirámide min/max por canal de un registro .emgz.
+
+    El nivel 0 resume cubetas de BASE muestras y cada nivel superior agrupa FACTOR
+    cubetas del anterior. Se construye en un hilo; mientras tanto las cubetas aún no
+    leídas se devuelven como NaN y la vista se va completando.
+    """
+    BASE = 64
+    FACTOR = 8
+
+    def __init__(self, reader: 'EMGZReader'):
+        self.reader = reader
+        nb = max(-(-reader.n_samples // self.BASE), 1)
+        self._mins = [np.full((nb, reader.nch), np.iinfo(np.uint16).max, dtype=np.uint16)]
+        self._maxs = [np.zeros((nb, reader.nch), dtype=np.uint16)]
+        self.chunks_done = 0
+        self.ready = False
+        self._stop = False
+        self._thread = threading.Thread(target=self._build, name="EMGOverview", daemon=True)
+        self._thread.start()
+
+    def _build(self):
+        base = self.BASE
+        mins0, maxs0 = self._mins[0], self._maxs[0]
+        for i in range(self.reader.n_chunks):
+            if self._stop:
+                return
+            first, _, nsamp = self.reader.chunk_info(i)
+            data = self.reader.decode_chunk(i)
+            # Límites de cubeta globales dentro del chunk (tolera chunks no alineados)
+            cuts = np.arange(-(-first // base) * base, first + nsamp, base) - first
+            if len(cuts) == 0 or cuts[0] != 0:
+                cuts = np.concatenate(([0], cuts))
+            ids = (first + cuts) // base
+            mins0[ids] = np.minimum(mins0[ids], np.minimum.reduceat(data, cuts, axis=0))
+            maxs0[ids] = np.maximum(maxs0[ids], np.maximum.reduceat(data, cuts, axis=0))
+            self.chunks_done = i + 1
+
+        while len(self._mins[-1]) > self.FACTOR:
+            mn, mx = self._mins[-1], self._maxs[-1]
+            pad = (-len(mn)) % self.FACTOR
+            if pad:
+                mn = np.concatenate((mn, np.repeat(mn[-1:], pad, axis=0)))
+                mx = np.concatenate((mx, np.repeat(mx[-1:], pad, axis=0)))
+            nch = mn.shape[1]
+            self._mins.append(mn.reshape(-1, self.FACTOR, nch).min(axis=1))
+            self._maxs.append(mx.reshape(-1, self.FACTOR, nch).max(axis=1))
+        self.ready = True
+
+    def stop(self):
+        """Detiene la construcción y espera al hilo; después ya se puede cerrar el lector.
+
+        El hilo mira '_stop' antes de cada chunk, así que la espera es como mucho una
+        decodificación.
+        """
+        self._stop = True
+        self._thread.join()
+
+    def envelope(self, start: int, stop: int, max_points: int):
+        """Cubetas que cubren [start, stop): (muestra inicial de cada cubeta, min, max) en cuentas ADC."""
+        level, size = 0, self.BASE
+        while self.ready and level + 1 < len(self._mins) and (stop - start) / size > max_points:
+            level += 1
+            size *= self.FACTOR
+        b0 = max(start // size, 0)
+        b1 = min(-(-stop // size), len(self._mins[level]))
+        mn = self._mins[level][b0:b1].astype(np.float64)
+        mx = self._maxs[level][b0:b1].astype(np.float64)
+
+        # Nivel 0 mientras se construye la pirámide: reduce al vuelo hasta max_points
+        k = -(-len(mn) // max(max_points, 1))
+        if k > 1:
+            pad = (-len(mn)) % k
+            if pad:
+                mn = np.concatenate((mn, np.repeat(mn[-1:], pad, axis=0)))
+                mx = np.concatenate((mx, np.repeat(mx[-1:], pad, axis=0)))
+            mn = mn.reshape(-1, k, mn.shape[1]).min(axis=1)
+            mx = mx.reshape(-1, k, mx.shape[1]).max(axis=1)
+            size *= k
+
+        empty = mn > mx   # cubetas aún sin datos
+        mn[empty] = np.nan; mx[empty] = np.nan
+        starts = b0 * (size // max(k, 1)) + np.arange(len(mn)) * size
+        return starts, mn, mx
@@ -0,0 +1,374 @@
+"""Simulador del firmware EMG sobre un pseudo-terminal, para pruebas sin hardware.
+
+Crea un pty que habla el mismo protocolo que el STM32: emite frames A5 5A / A5 5B con
+nch/nsamp/seq/checksum y atiende los comandos de 5 caracteres que envía la interfaz.
+La señal es EMG bipolar sintética con contracciones (ráfagas) por canal; se puede
+inyectar ruido, bytes corruptos, frames perdidos, temporización a ráfagas y deriva del
+reloj del dispositivo (--drift-ppm) para validar la sincronía del motor.
+
+    python simulador_emg.py                      # imprime la ruta del pty para conectar la GUI
+    python simulador_emg.py --soak 3600 --report 60 --corrupt 1e-4 --drop 0.01
+
+En modo --soak el propio proceso conecta el motor de adquisición al pty y reporta
+memoria residente y rendimiento de decodificación durante la prueba.
+"""
+import sys
+import os
+import time
+import threading
+import argparse
+import select
+import numpy as np
+
+from motor_emg import (AcquisitionEngine, ACQ_PROFILES, DEFAULT_ACQ_PROFILE, FRAME_HDR, FRAME_HDR_PACKED, MAX_CHANNELS,
+                       CMD_WIRE_PACKED12, CMD_WIRE_U16, GAINS, pack12, parse_channel_command, process_rss_mb)
+
+
+def _bandpass_kernel(fs: float, f_lo: float, f_hi: float, taps: int = 63) -> np.ndarray:
+    """FIR pasa banda por ventana (sinc(f_hi) - sinc(f_lo)) con Hamming."""
+    f_hi = min(f_hi, 0.45 * fs)
+    n = np.arange(taps) - (taps - 1) / 2
+    h = 2 * f_hi / fs * np.sinc(2 * f_hi / fs * n) - 2 * f_lo / fs * np.sinc(2 * f_lo / fs * n)
+    h *= np.hamming(taps)
+    return h / np.sqrt(np.sum(h ** 2))
+
+
+class _StatefulFIR:
+    """FIR por bloques que conserva la cola de entrada: la salida es continua entre bloques."""
+    def __init__(self, kernel: np.ndarray, nch: int):
+        self.kernel = kernel
+        self.hist = np.zeros((len(kernel) - 1, nch))
+
+    def __call__(self, x: np.ndarray) -> np.ndarray:
+        xx = np.concatenate((self.hist, x))
+        self.hist = xx[-(len(self.kernel) - 1):]
+        return np.stack([np.convolve(xx[:, c], self.kernel, mode='valid') for c in range(x.shape[1])], axis=1)
+
+
+class EMGSynth:
+    """EMG bipolar sintético: ruido pasa banda 20-450 Hz modulado por contracciones.
+
+    Cada canal alterna reposo y contracción (duraciones aleatorias, rampas de coseno).
+    La configuración por canal (ganancia, tipo de señal) imita lo que haría el firmware.
+    """
+    RAMP_S = 0.15
+
+    def __init__(self, fs: float, nch: int, rng: np.random.Generator,
+                 mvc_counts: float = 600.0, rest_counts: float = 15.0, mains_hz: float = 50.0,
+                 mains_counts: float = 8.0):
+        self.fs = float(fs)
+        self.nch = nch
+        self.rng = rng
+        self.mvc = mvc_counts
+        self.rest = rest_counts
+        self.mains_hz = mains_hz
+        self.mains = mains_counts
+        self.t = 0
+        self._bp = _StatefulFIR(_bandpass_kernel(self.fs, 20.0, 450.0), nch)
+        self._env = _StatefulFIR(np.ones(max(int(0.05 * self.fs), 1)) / max(int(0.05 * self.fs), 1), nch)
+        self.gain_idx = [0] * nch
+        self.signal_type = [0] * nch
+        # Próxima contracción por canal: (inicio, fin, amplitud relativa) en muestras
+        self._bursts = [self._next_burst(0) for _ in range(nch)]
+
+    def configure(self, ch: int, gain_idx: int, signal_type: int):
+        if 0 <= ch < self.nch:
+            self.gain_idx[ch] = gain_idx
+            self.signal_type[ch] = signal_type
+
+    def _next_burst(self, after: int):
+        start = after + int(self.rng.uniform(1.0, 3.0) * self.fs)
+        end = start + int(self.rng.uniform(0.5, 2.0) * self.fs)
+        return start, end, self.rng.uniform(0.3, 1.0)
+
+    def _envelope(self, ch: int, n: int) -> np.ndarray:
+        t = np.arange(self.t, self.t + n)
+        env = np.zeros(n)
+        ramp = self.RAMP_S * self.fs
+        while True:
+            start, end, amp = self._bursts[ch]
+            if start >= self.t + n:
+                break
+            up = np.clip((t - start) / ramp, 0.0, 1.0)
+            down = np.clip((end - t) / ramp, 0.0, 1.0)
+            env = np.maximum(env, amp * 0.5 * (1 - np.cos(np.pi * np.minimum(up, down))))
+            if end + ramp > self.t + n:
+                break
+            self._bursts[ch] = self._next_burst(end)
+        return env
+
+    def block(self, n: int) -> np.ndarray:
+        """Siguiente bloque (n, nch) en cuentas ADC u16."""
+        raw = self._bp(self.rng.standard_normal((n, self.nch)))
+        env = np.stack([self._envelope(ch, n) for ch in range(self.nch)], axis=1)
+        gain = np.array([float(GAINS[g]) if 0 <= g < len(GAINS) else 10.0 for g in self.gain_idx]) / 10.0
+        emg = raw * (self.rest + self.mvc * env) * gain
+        t = np.arange(self.t, self.t + n) / self.fs
+        emg += self.mains * np.sin(2 * np.pi * self.mains_hz * t)[:, None]
+
+        # Procesado del canal según el tipo de señal configurado
+        rect = np.abs(emg)
+        smooth = self._env(rect)
+        out = np.empty_like(emg)
+        for ch in range(self.nch):
+            kind = self.signal_type[ch]
+            if kind == 1:
+                out[:, ch] = 2 * rect[:, ch]
+            elif kind == 2:
+                out[:, ch] = 2 * smooth[:, ch]
+            else:
+                out[:, ch] = 2048 + emg[:, ch]
+        self.t += n
+        return np.clip(np.rint(out), 0, 4095).astype(np.uint16)
+
+
+class FirmwareSimulator:
+    """Emisor de frames sobre el lado maestro de un pty, con fallos inyectables."""
+    def __init__(self, fs=600, nch=MAX_CHANNELS, nsamp=30, noise=0.0, corrupt=0.0, drop=0.0,
+                 burst=0.0, jitter_ms=0.0, baud=0, packed=False, seed=None, drift_ppm=0.0, verbose=True):
+        import pty
+        import tty
+        self.fs, self.nch, self.nsamp = float(fs), int(nch), int(nsamp)
+        self.noise, self.corrupt, self.drop = float(noise), float(corrupt), float(drop)
+        self.burst, self.jitter = float(burst), float(jitter_ms) / 1000.0
+        self.baud = int(baud)
+        self.packed = bool(packed)
+        self.drift_ppm = float(drift_ppm)    # + = el "oscilador" muestrea más rápido que fs
+        self.verbose = verbose
+        self.rng = np.random.default_rng(seed)
+        self.synth = EMGSynth(self.fs, self.nch, self.rng)
+
+        self.master, self._slave = pty.openpty()
+        tty.setraw(self.master)
+        tty.setraw(self._slave)   # sin eco ni traducción de fin de línea
+        self.port = os.ttyname(self._slave)
+
+        self.seq = 0
+        self.frames_sent = 0
+        self.frames_dropped = 0
+        self.bytes_corrupted = 0
+        self.commands = []
+        self._cmd_buf = bytearray()
+        self._stop = threading.Event()
+        self._thread = None
+
+    def start(self):
+        self._thread = threading.Thread(target=self._run, name="FirmwareSimulator", daemon=True)
+        self._thread.start()
+
+    def stop(self):
+        self._stop.set()
+        if self._thread is not None:
+            self._thread.join(timeout=2.0)
+        for fd in (self.master, self._slave):
+            try:
+                os.close(fd)
+            except OSError:
+                pass
+
+    def build_frame(self, block: np.ndarray) -> bytes:
+        nsamp, nch = block.shape
+        payload = pack12(block) if self.packed else block.astype('<u2').tobytes()
+        hdr = FRAME_HDR_PACKED if self.packed else FRAME_HDR
+        body = hdr + bytes([nch]) + nsamp.to_bytes(2, 'little') + (self.seq & 0xFFFF).to_bytes(2, 'little') + payload
+        return body + bytes([sum(body) & 0xFF])
+
+    def _inject(self, frame: bytes) -> bytes:
+        if self.corrupt <= 0:
+            return frame
+        hits = np.nonzero(self.rng.random(len(frame)) < self.corrupt)[0]
+        if len(hits) == 0:
+            return frame
+        buf = bytearray(frame)
+        for i in hits:
+            buf[i] ^= 1 << int(self.rng.integers(0, 8))
+        self.bytes_corrupted += len(hits)
+        return bytes(buf)
+
+    def _poll_commands(self):
+        while True:
+            r, _, _ = select.select([self.master], [], [], 0)
+            if not r:
+                break
+            try:
+                data = os.read(self.master, 256)
+            except OSError:
+                break
+            if not data:
+                break
+            self._cmd_buf.extend(data)
+        while len(self._cmd_buf) >= 5:
+            cmd = self._cmd_buf[:5].decode('ascii', 'replace')
+            del self._cmd_buf[:5]
+            self._handle_command(cmd)
+
+    def _handle_command(self, cmd: str):
+        self.commands.append(cmd)
+        if cmd == CMD_WIRE_PACKED12:
+            self.packed = True
+        elif cmd == CMD_WIRE_U16:
+            self.packed = False
+        else:
+            try:
+                c = parse_channel_command(cmd)
+            except ValueError:
+                if self.verbose:
+                    print(f"[SIM] Comando ignorado: {cmd!r}")
+                return
+            self.synth.configure(c['channel'], c['gain'], c['signal_type'])
+        if self.verbose:
+            print(f"[SIM] Comando recibido: {cmd}")
+
+    def _run(self):
+        period = self.nsamp / (self.fs * (1.0 + self.drift_ppm * 1e-6))
+        next_t = time.monotonic()
+        held = []
+        while not self._stop.is_set():
+            self._poll_commands()
+
+            block = self.synth.block(self.nsamp)
+            if self.noise > 0:
+                block = np.clip(block + self.rng.normal(0, self.noise, block.shape), 0, 4095).astype(np.uint16)
+            frame = self._inject(self.build_frame(block))
+            self.seq += 1
+            if self.drop > 0 and self.rng.random() < self.drop:
+                self.frames_dropped += 1
+            else:
+                held.append(frame)
+
+            # Temporización a ráfagas: retiene frames y los suelta juntos
+            if self.burst > 0 and self.rng.random() < self.burst and len(held) < 20:
+                pass
+            elif held:
+                data = b''.join(held)
+                n_held = len(held)
+                held.clear()
+                try:
+                    os.write(self.master, data)
+                except OSError:
+                    break
+                self.frames_sent += n_held
+
+            # Ritmo nominal (o el del baudrate emulado si es más lento) + jitter
+            wire_s = (len(frame) * 10.0 / self.baud) if self.baud > 0 else 0.0
+            next_t += max(period, wire_s)
+            if self.jitter > 0:
+                next_t += self.rng.uniform(-self.jitter, self.jitter)
+            self._stop.wait(max(next_t - time.monotonic(), 0.0))
+
+
+def run_soak(sim: FirmwareSimulator, duration_s: float, report_s: float, record: str = None,
+             config=()) -> int:
+    """Conecta el motor al pty, consume como lo haría la GUI y reporta memoria y rendimiento."""
+    from registro_emg import EMGRecorder, EMGZWriter
+
+    # Perfil con la misma frecuencia que el simulador (si lo hay) para dimensionar el anillo
+    profile = next((name for name, prof in ACQ_PROFILES.items() if prof['sampling_rate'] == sim.fs),
+                   DEFAULT_ACQ_PROFILE)
+    engine = AcquisitionEngine(profile)
+    q = engine.subscribe()
+    consumed = [0]
+    stop = threading.Event()
+
+    def consumer():
+        # Emula al consumidor de la GUI: vacía la cola cada 50 ms
+        while not stop.is_set():
+            while not q.empty():
+                _, arr, _ = q.get_nowait()
+                consumed[0] += len(arr)
+            stop.wait(0.05)
+
+    threading.Thread(target=consumer, daemon=True).start()
+    engine.open({'port': sim.port, 'baudrate': 115200, 'timeout': 0.05})
+    for cmd in config:
+        engine.send_command(cmd)
+    rec = None
+    if record:
+        rec = EMGRecorder(EMGZWriter(record, MAX_CHANNELS, sim.fs, 3.3, 4095))
+        engine.add_sink(rec)
+
+    t0 = time.monotonic()
+    samples = []   # (t, rss)
+    status = 0
+    try:
+        while time.monotonic() - t0 < duration_s:
+            time.sleep(min(report_s, max(duration_s - (time.monotonic() - t0), 0.0)))
+            err = engine.take_error()
+            if err is not None:
+                print(f"[ERROR] El motor perdió la conexión: {err}")
+                status = 1
+                break
+            t, rss = time.monotonic() - t0, process_rss_mb()
+            samples.append((t, rss))
+            m = engine.metrics.snapshot()
+            print(f"[SOAK] t={t:.0f}s rss={rss:.1f}MB muestras={m['samples']} "
+                  f"({m['samples_per_s']:.0f}/s, decod. {m['decode_samples_per_s'] / 1e6:.2f} M/s) "
+                  f"chk_err={m['checksum_errors']} saltos_seq={m['seq_gaps']} "
+                  f"descartados={m['dropped_blocks']} deriva={m['drift_ppm']:+.1f}ppm "
+                  f"(sim {sim.drift_ppm:+.1f}) | sim: enviados={sim.frames_sent} "
+                  f"perdidos={sim.frames_dropped} corruptos={sim.bytes_corrupted}", flush=True)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        stop.set()
+        engine.close()
+        if rec is not None:
+            engine.remove_sink(rec)
+            rec.stop()
+
+    # Crecimiento de memoria: pendiente de RSS tras descartar el primer 20% (calentamiento)
+    tail = samples[len(samples) // 5:]
+    if len(tail) >= 2:
+        t = np.array([s[0] for s in tail]); r = np.array([s[1] for s in tail])
+        slope = np.polyfit(t, r, 1)[0] * 3600.0
+        print(f"[SOAK] RSS {tail[0][1]:.1f} -> {tail[-1][1]:.1f} MB, tendencia {slope:+.2f} MB/h; "
+              f"muestras consumidas={consumed[0]}")
+    return status
+
+
+def main(argv=None) -> int:
+    parser = argparse.ArgumentParser(description="Simulador del firmware EMG sobre un pty.")
+    parser.add_argument('--fs', type=float, default=600.0, help="Frecuencia de muestreo por canal (Hz)")
+    parser.add_argument('--nch', type=int, default=MAX_CHANNELS)
+    parser.add_argument('--nsamp', type=int, default=30, help="Muestras por canal en cada frame")
+    parser.add_argument('--noise', type=float, default=0.0, help="Ruido gaussiano añadido (cuentas ADC rms)")
+    parser.add_argument('--corrupt', type=float, default=0.0, help="Probabilidad de corromper cada byte")
+    parser.add_argument('--drop', type=float, default=0.0, help="Probabilidad de perder cada frame")
+    parser.add_argument('--burst', type=float, default=0.0, help="Probabilidad de retener un frame para enviarlo en ráfaga")
+    parser.add_argument('--jitter', type=float, default=0.0, help="Jitter de temporización (ms)")
+    parser.add_argument('--baud', type=int, default=0, help="Emular el límite de un enlace de N baudios (0 = sin límite)")
+    parser.add_argument('--packed', action='store_true', help="Arrancar enviando datos de 12 bits empaquetados")
+    parser.add_argument('--drift-ppm', type=float, default=0.0, help="Deriva del reloj simulado (ppm)")
+    parser.add_argument('--seed', type=int, default=None)
+    parser.add_argument('--soak', type=float, default=0.0, help="Prueba de larga duración de N segundos con el motor")
+    parser.add_argument('--report', type=float, default=60.0, help="Intervalo de reporte del soak (s)")
+    parser.add_argument('--record', help="Durante el soak, grabar también a este .emgz")
+    parser.add_argument('--config', action='append', default=[], metavar='CGLHT',
+                        help="Durante el soak, comandos de canal a enviar al conectar")
+    args = parser.parse_args(argv)
+
+    if args.nch < 1 or args.nch > MAX_CHANNELS:
+        parser.error(f"--nch debe estar entre 1 y {MAX_CHANNELS}")
+    try:
+        sim = FirmwareSimulator(args.fs, args.nch, args.nsamp, args.noise, args.corrupt, args.drop,
+                                args.burst, args.jitter, args.baud, args.packed, args.seed,
+                                drift_ppm=args.drift_ppm, verbose=args.soak <= 0)
+    except (ImportError, OSError) as e:
+        print(f"[ERROR] No se pudo crear el pseudo-terminal: {e}", file=sys.stderr)
+        return 2
+    sim.start()
+
+    try:
+        if args.soak > 0:
+            return run_soak(sim, args.soak, args.report, args.record, args.config)
+        print(f"[SIM] Dispositivo simulado en {sim.port} ({args.fs:.0f} Hz, {args.nch} canales). Ctrl+C para terminar.")
+        while True:
+            time.sleep(1.0)
+    except KeyboardInterrupt:
+        return 0
+    finally:
+        sim.stop()
+
+
+if __name__ == '__main__':
+    sys.exit(main())